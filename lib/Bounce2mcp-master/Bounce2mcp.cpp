@@ -17,14 +17,14 @@ BounceMcp::BounceMcp()
     , interval_millis(10)
     , state(0)
     , pin(0)
+    , mcpX(nullptr)
 {}
 
-void BounceMcp::attach(Adafruit_MCP23X17 mcpX, int pin, uint16_t interval_millis) {
+void BounceMcp::attach(Adafruit_MCP23X17 &mcpX, int pin, uint16_t interval_millis) {
     this->pin = pin;
-    this->mcpX = mcpX;
+    this->mcpX = &mcpX;
     this->interval_millis = interval_millis;
 
-    bool read = mcpX.digitalRead(pin);
     state = 0;
     if (mcpX.digitalRead(pin)) {
         state = _BV(DEBOUNCED_STATE) | _BV(UNSTABLE_STATE);
@@ -42,12 +42,30 @@ void BounceMcp::interval(uint16_t interval_millis)
 }
 
 bool BounceMcp::update()
+{
+    return apply(mcpX->digitalRead(pin));
+}
+
+bool BounceMcp::update(uint16_t portBits)
+{
+    return apply(portBits & (1 << pin));
+}
+
+bool BounceMcp::settling()
+{
+#ifdef BOUNCE_LOCK_OUT
+    return false; // changes are taken right away
+#else
+    return (bool)(state & _BV(UNSTABLE_STATE)) != (bool)(state & _BV(DEBOUNCED_STATE));
+#endif
+}
+
+bool BounceMcp::apply(bool currentState)
 {
 #ifdef BOUNCE_LOCK_OUT
     state &= ~_BV(STATE_CHANGED);
     // Ignore everything if we are locked out
     if (millis() - previous_millis >= interval_millis) {
-        bool currentState = mcpX.digitalRead(pin);
         if ((bool)(state & _BV(DEBOUNCED_STATE)) != currentState) {
             previous_millis = millis();
             state ^= _BV(DEBOUNCED_STATE);
@@ -56,8 +74,6 @@ bool BounceMcp::update()
     }
     return state & _BV(STATE_CHANGED);
 #else
-    // Read the state of the switch in a temporary variable.
-    bool currentState = mcpX.digitalRead(pin);
     state &= ~_BV(STATE_CHANGED);
 
     // If the reading is different from last reading, reset the debounce counter
@@ -48,7 +48,8 @@ class BounceMcp
     BounceMcp();
 
     // Attach to a MCP object, a pin (and also sets initial state), and set debounce interval.
-    void attach(Adafruit_MCP23X17 mcpX, int pin, uint16_t interval_millis);
+    // The MCP object is referenced, not copied - it has to outlive the BounceMcp.
+    void attach(Adafruit_MCP23X17 &mcpX, int pin, uint16_t interval_millis);
 
     // Sets the debounce interval
     void interval(uint16_t interval_millis);
@@ -58,6 +59,13 @@ class BounceMcp
     // Returns 0 if the state did not change
     bool update();
 
+    // Updates the pin from the 16 port bits of one readGPIOAB() shared by all buttons, no I2C transfer
+    // Returns 1 if the state changed
+    bool update(uint16_t portBits);
+
+    // Returns 1 while a change is still being debounced - update() has to be called again after the interval
+    bool settling();
+
     // Returns the updated pin state
     bool read();
 
@@ -72,7 +80,9 @@ class BounceMcp
     uint16_t interval_millis;
     uint8_t state;
     uint8_t pin;
-    Adafruit_MCP23X17 mcpX;
+    Adafruit_MCP23X17 *mcpX;
+
+    bool apply(bool currentState);
 };
 
 #endif
@@ -128,17 +128,24 @@ Rotary::Rotary(char _pin1, char _pin2) {
   pin1 = _pin1;
   pin2 = _pin2;
   // Set pins to input.
+#if defined(ENABLE_PULLUPS) && defined(ESP32)
+  // writing HIGH to an input does not switch on the pullup here. pins 34..39 have none at all, an encoder on
+  // them needs external pull up resistors
+  pinMode(pin1, INPUT_PULLUP);
+  pinMode(pin2, INPUT_PULLUP);
+#else
   pinMode(pin1, INPUT);
   pinMode(pin2, INPUT);
 #ifdef ENABLE_PULLUPS
   digitalWrite(pin1, HIGH);
   digitalWrite(pin2, HIGH);
+#endif
 #endif
   // Initialise state.
   state = R_START;
 }
 
-unsigned char Rotary::process() {
+unsigned char ARDUINO_ISR_ATTR Rotary::process() {
   // Grab state of input pins.
   unsigned char pinstate = (digitalRead(pin2) << 1) | digitalRead(pin1);
   // Determine new state from the pins and state table.
@@ -7,6 +7,11 @@
 
 #include "Arduino.h"
 
+// process() is usually called from a pin change interrupt
+#ifndef ARDUINO_ISR_ATTR
+#define ARDUINO_ISR_ATTR
+#endif
+
 // Enable this to emit codes twice per step.
 //#define HALF_STEP
 
@@ -5,7 +5,7 @@
  * @author Lars Deutsch (deutsch.lars@gmail.com)
  * @brief this program implements a serial logger using the serial2 port of the esp32. screen orientation, font size and port speed can be configured during operation. Also the program implements a telnet server, which lets you monitor serial lines and debug information remotely
  * (My personal version comes with an usb-c charger for a 26650 li-ion battery - but feel free to power the circuit directly via usb-c or micro usb adapter)
- * The second swithc using pin 21 is used to halt serial output on the fly - when action is too fast to read ... attention: all messages received when in pause mode will be discarded !
+ * The second swithc using pin 21 is used to halt serial output on the fly - when action is too fast to read ... capture goes on while paused: telnet keeps receiving, the history keeps filling and the last screenful is shown on resume
  * 
  * To make this sketch work, you need to wire the data lines of a standard tft lcd display (mine uses 480x320, 4") according to the User_Setup.h file in the tft_espi library folder of the platform io project:
  * 
@@ -18,7 +18,14 @@
  * #define TFT_RST  32  
  * #define TFT_BL   22  // LED back-light (required for M5Stack)
  * 
- * serial2 lines are pins 16 and 17
+ * the sd card slot of the tft module shares MISO/MOSI/SCLK, its chip select goes to pin 27 (SD_CS)
+ * optionally connect T_IRQ of the touch controller to a free pin and set TOUCH_IRQ, touch is then only read while pressed
+ *
+ * optional panel controls: a rotary encoder (set ENCODER_A_PIN / ENCODER_B_PIN, e.g. 34 and 35 - these have no
+ * internal pull ups, the encoder needs external ones, most encoder boards have them) scrolls the history, an MCP23017 on i2c (SDA 13, SCL 14, address 0x20) with its INTA on pin 39 carries the pause,
+ * mark and menu buttons on GPA0..GPA2 (to ground)
+ * 
+ * serial2 lines are pins 16 and 17, the second capture channel on serial1 uses pins 26 (rx) and 25 (tx)
  * 
  * The sketch implements ArduinoOTA, port 8266, default pwd: 123
  * 
@@ -28,9 +35,7 @@
  * 
  * on my bucket list for improvements:
  * - implement WifiManager
- * - write log to sd card of tft screen (will need a new 3d printed case for this ...)
  * - level shifter 5v<->3,3v
- * - use two serial ports (would be a major overhaul, maybe with two tft displays)
  * - implement progress screen for OTA
  * - some minor glitches in scrollcode need fixing
  *  * 
@@ -63,6 +68,25 @@
 #include <ArduinoOTA.h>
 #include <TelnetSpy.h>
 #include <Wire.h>
+#include <esp_timer.h>
+#include "uart_ingest.h"
+#include "line_assembler.h"
+#include "line_renderer.h"
+#include "text_rows.h"
+#include "history.h"
+#include "stream_server.h"
+#include "mqtt_link.h"
+#include "mqtt_batch.h"
+#include "wifi_link.h"
+#include "line_clock.h"
+#include "spi_bus.h"
+#include "sd_logger.h"
+#include "touch_input.h"
+#include "panel_input.h"
+#include "monitor_stats.h"
+#include "line_filter.h"
+#include "text_layout.h"
+#include "settings_store.h"
 
 #if not defined(ST7796_DRIVER) // check if tft_espi is configured correctly - change in header files and here for the display of your choice
   #error "wrong display driver defined!"
@@ -86,24 +110,66 @@ char* mqtt_username = (char *)&strSecrets[3];
 char* mqtt_password = (char *)&strSecrets[4];
 int mqtt_port = 1883;
 TFT_eSPI tft = TFT_eSPI();
+SpiBus spiBus; // tft, touch and sd card share the bus
+
+#define SD_CS 27
+SdLogger sdLog; // history lines with their stamps on the sd card
 
 // Create 12 buttons for the configuration menu
-char keyLabel[12][15] = {"1", "2", "3","landscape","portrait","exit","9600","19200","38400","57600","115200","230400"};
+char keyLabel[12][15] = {"1", "2", "3","landscape","portrait","exit","9600","115k2","460k8","921k6","2M","auto"};
 uint16_t keyColor[12] = {TFT_BLACK, TFT_BLACK, TFT_BLACK,TFT_BLUE, TFT_BLUE, TFT_RED,TFT_DARKGREY,TFT_DARKGREY,TFT_DARKGREY,TFT_DARKGREY,TFT_DARKGREY,TFT_DARKGREY};
 // Invoke the TFT_eSPI button class and create all the button objects
 TFT_eSPI_Button key[12];
 
-WiFiClient espClient;
-PubSubClient client(espClient);
+MqttLink mqtt; // broker connection, reconnects in the background
+MqttBatcher mqttOut; // publishes the history in batches
+
+#define TELNET_DATA_PORT 24    // captured serial text
+#define TELNET_DATA_PORT2 2324 // the same for the second channel, clear of the well-known ports (25 is smtp)
+#define TELNET_LOG_PORT 23     // debug messages of the monitor itself
+#define RAW_BRIDGE_PORT 2000 // exact serial2 byte stream in both directions (ser2net style), serial1 on 2001
+#define RAW_FLUSH_BYTES 1460 // one tcp segment
+#define RAW_FLUSH_MS 0       // 0 sends every chunk right away, > 0 batches into fewer and larger packets
+#ifndef RAW_REPLAY
+#define RAW_REPLAY 0         // 1: new raw bridge clients get the recent lines as text first, 0 keeps the port byte exact
+#endif
 
 bool ConnectionEstablished; // Flag for successfully handled telnet connection on port 24
 TelnetSpy LOG;
+StreamServer telnet(TELNET_DATA_PORT, 1024, 20);
+StreamServer telnet2(TELNET_DATA_PORT2, 1024, 20);
+StreamServer rawBridge(RAW_BRIDGE_PORT, RAW_FLUSH_BYTES, RAW_FLUSH_MS);
+StreamServer rawBridge2(RAW_BRIDGE_PORT + 1, RAW_FLUSH_BYTES, RAW_FLUSH_MS);
+
+#define RX2_PIN 16
+#define TX2_PIN 17
+#define RX1_PIN 26 // second capture channel
+#define TX1_PIN 25
+#define CHANNELS 2
+#define LANDSCAPE_FRAME_MS 40 // coalesce scrolling in landscape into at most 25 redraws per second
+#define SWIPE_MIN 40 // vertical finger travel in pixels that makes a swipe instead of a tap
+#define TOUCH_IRQ -1 // pen interrupt (T_IRQ) of the touch controller, -1 if not wired: polled at 25 Hz instead
+#define ENCODER_A_PIN -1 // rotary encoder, -1 if not wired. 34 and 35 are free but input only without pull ups:
+#define ENCODER_B_PIN -1 // an encoder there needs external ones, unconnected they pick up noise
+#define PANEL_SDA_PIN 13 // i2c of the button expander, pins 21 and 22 are taken by the pause switch and backlight
+#define PANEL_SCL_PIN 14
+#define PANEL_MCP_ADDRESS 0x20
+#define PANEL_INT_PIN 39 // INTA of the expander, -1 if there is none
+#define RX_LOOP_BUDGET 2048 // max bytes taken from the ingest ring per loop pass, so network handlers keep running
+#define NTP_SERVER "pool.ntp.org" // "" keeps the line stamps relative to boot
+#define CLOCK_TZ "UTC0"           // posix TZ string for the wall clock stamps
+#define SCREEN_TIMESTAMPS false   // show the receive time in front of every line, also set by mqtt {"stamps":true}
+#define LINE_FILTER ""            // screen filter rules at boot, e.g. "+ERROR|-heartbeat|*WARN" - see line_filter.h
+                                  // (both only until settings changed in the menu or over mqtt are saved)
+#define HIGHLIGHT_COLOUR TFT_RED  // lines matching a highlight rule
 
 int fontsize = 1;     //font choosen by configuration
-int serialspeed = 1;  //1-5 represents the serial speed of the serial2 port
+int serialspeed = 1;  //1-6 represents the serial speed of the serial ports, see menuBaud
+// baud rates of the serial speed buttons, 0 = auto baud. any other rate can be set over mqtt
+const uint32_t menuBaud[6] = {9600, 115200, 460800, 921600, 2000000, 0};
 
 int TEXT_HEIGHT=16; // initial height of text to be printed and scrolled
-#define BOT_FIXED_AREA 0 // Number of lines in bottom fixed area (lines counted from bottom of screen)
+#define BOT_FIXED_AREA 10 // Number of lines in bottom fixed area (lines counted from bottom of screen), the status bar
 #define TOP_FIXED_AREA 0 // Number of lines in top fixed area (lines counted from top of screen)
 int YMAX = 480; 
 int XMAX = 320;
@@ -114,10 +180,61 @@ uint16_t yStart = TOP_FIXED_AREA;
 uint16_t yArea = YMAX - TOP_FIXED_AREA-BOT_FIXED_AREA;
 // The initial y coordinate of the top of the bottom text line
 uint16_t yPos = TOP_FIXED_AREA;
+// false while the first screen is still being filled from the top
+bool scrollActive = false;
 uint16_t fontOffset = 0;
 
-// Keep track of the drawing x coordinate
-uint16_t xPos = 0;
+// font of the serial text lines, nullptr is the built in glcd font 1
+const GFXfont *lineFont = nullptr;
+
+LineRenderer lineOut(&tft);  // draws them through a line sprite
+TextRows screenRows;         // landscape: text of the visible rows, redrawn where changed
+TouchInput touch(&tft);      // touch events, sampled outside of the main loop
+PanelInput panel;            // encoder and expander buttons, interrupt driven
+LineHistory history;         // scrollback of all assembled lines
+LineFilter lineFilter;       // decides which lines reach the screen, everything is still captured
+LayoutCache layout;          // screen rows of the history lines for the current font and width
+
+#define LAYOUT_STEP 8 // history lines laid out per loop pass after a font or orientation change
+uint32_t relayoutNext = 0; // lines before it are laid out next, walking back from the top of the screen
+uint16_t relayoutLeft = 0;
+
+#define MENU_TIMEOUT_MS 10000 // the config menu closes unchanged after this long without a touch
+bool menuOpen = false;        // the config menu covers the screen
+uint32_t menuOpenedAt = 0;    // millis() of the last touch in the menu
+int menuOrientation = 0;      // orientation to return to
+
+bool viewingHistory = false; // a scrollback page is shown instead of the live lines
+uint32_t viewEnd = 0;        // sequence number following the last history line on screen
+uint32_t viewStart = 0;      // first line on screen, live or history
+bool viewPartial = false;    // only the lower rows of that line fit
+
+bool showStamps = SCREEN_TIMESTAMPS;
+
+SettingsStore settingsStore; // saved baud rates, font, orientation, stamps, filter and touch calibration
+StoredSettings settings = {0, 0, 1, {9600, 9600}, 0, SCREEN_TIMESTAMPS, 0, 0, {0}, LINE_FILTER};
+bool networkStarted = false; // file system, sd card and network are up, see startServices
+
+#define STATS_PUBLISH_MS 10000 // monitor counters to serialmonitor/<client id>/stats
+#define STATUS_BAR_COLOUR TFT_NAVY
+bool statusDirty = true; // the status bar was cleared and is drawn again with the next sample
+
+// one capture channel: its uart, line assembly and network ports. the display interleaves the lines of both
+// channels in the channel colour
+struct Channel {
+  UartIngest *in;
+  StreamServer *telnet;
+  StreamServer *raw;
+  uint16_t colour;
+  LineAssembler lines;  // collects received bytes into display lines
+  bool lineStarted;     // the receive time of the line being assembled is known
+  int64_t lineStamp;    // esp_timer time of the first byte of that line
+};
+Channel channel[CHANNELS] = {
+  {&serialIn, &telnet, &rawBridge, TFT_WHITE},
+  {&serialIn2, &telnet2, &rawBridge2, TFT_YELLOW},
+};
+uint8_t openOwner = 0; // channel whose incomplete line is shown on the open row
 
 // touch calibration routine. Will be executed once if you havent done so, yet. Execute before putting the display into the 3d printed case!
 void touch_calibrate()
@@ -125,6 +242,11 @@ void touch_calibrate()
   uint16_t calData[5];
   uint8_t calDataOK = 0;
 
+  if (settings.touchValid && !REPEAT_CAL) { // kept in the nvs settings, no file system needed at boot
+    tft.setTouch(settings.touchCal);
+    return;
+  }
+
   // check if file system exists
   if (!SPIFFS.begin()) {
     Serial.println("Formating file system");
@@ -183,114 +305,103 @@ void touch_calibrate()
       f.close();
     }
   }
-}
-
-/********************************** START SETUP WIFI*****************************************/
-void setup_wifi() {
-
-  tft.fillScreen(TFT_BLACK);
-  tft.setTextColor(TFT_WHITE);
-  tft.setFreeFont(FM12);
-  tft.setCursor(20, 20);
 
-  delay(10);
-  // We start by connecting to a WiFi network
-  LOG.println();
-  LOG.print("Connecting to ");
-  LOG.println(ssid);
-
-  tft.println();
-  tft.print("Connecting to ");
-  tft.println(ssid);
-
-  LOG.print("WIFI status = ");
-  LOG.println(WiFi.getMode());
-  WiFi.disconnect(true);
-  delay(1000);
-  LOG.print("WIFI status = ");
-
-  WiFi.mode(WIFI_STA);
-  delay(1000);
-  WiFi.begin(ssid, password);
-
-  int nCount = 0;
-
-  while (WiFi.status() != WL_CONNECTED)
-  {
-    Serial.print(".");
-    tft.print(".");
-
-    nCount ++;
-
-    if (nCount >= 10) ESP.restart();
+  memcpy(settings.touchCal, calData, sizeof(calData));
+  settings.touchValid = 1;
+  if (!settingsStore.save(settings)) LOG.println("settings: nvs write failed");
+}
 
-    delay(1000);
+/********************************** WIFI EVENTS*****************************************/
+bool otaStarted = false;
+
+// runs whenever the link state changes: OTA starts with the first connection, the network consumers pick up
+// from the history - capture itself never waited for the network
+void networkStatus() {
+  static bool wasOnline = false;
+  static uint32_t offlineSeq = 0;
+
+  if (wifi.takeConnected()) {
+    LOG.print("WiFi connected, IP address: ");
+    LOG.println(WiFi.localIP());
+    if (wifi.disconnects() > 0) {
+      LOG.printf("offline for %u ms, %u lines captured meanwhile\n", (unsigned)wifi.offlineMs(),
+                 (unsigned)(history.end() - offlineSeq));
+    }
+    if (!otaStarted) {
+      ArduinoOTA.begin();
+      otaStarted = true;
+    }
+    wasOnline = true;
   }
 
-  LOG.println("");
-  LOG.println("WiFi connected");
-  LOG.println("IP address: ");
-  LOG.println(WiFi.localIP());
-
-  tft.println("");
-  tft.println("WiFi connected");
-  tft.println("IP address: ");
-  tft.println(WiFi.localIP());
+  if (wasOnline && !wifi.online()) {
+    LOG.printf("WIFI disconnected (reason %u), capture continues offline\n", wifi.lastReason());
+    offlineSeq = history.end();
+    wasOnline = false;
+  }
 }
 
 /********************************** MQTT callback*****************************************/
+// settings received on serialmonitor/<client id>/cmd, e.g. {"baud":115200,"font":2,"orientation":1,"pause":true}
+// or {"stamps":true}. "baud" and "baud2" take any rate up to INGEST_MAX_BAUD or "auto", "filter" takes a rule
+// spec like "+ERROR|*WARN" ("" removes all rules), the same as "filter <rules>" on the telnet data ports
+// the callback only parses, loop() applies them with applyRemoteConfig() - -1 means "leave as is"
+struct RemoteConfig {
+  int32_t baud;
+  int32_t baud2; // second channel
+  int8_t font;
+  int8_t orientation;
+  int8_t pause;
+  int8_t stamps;
+  bool pending;
+  bool filterSet; // filter holds new rules
+  char filter[FILTER_SPEC_MAX];
+};
+RemoteConfig remoteConfig = {-1, -1, -1, -1, -1, -1, false};
+bool remotePause = false; // pause requested over mqtt, works like the pin 21 switch
+char cmdTopic[64];
+char statusTopic[64];
+char statsTopic[64];
+
 void callback(char* topic, byte* payload, unsigned int length) {
-  //if you feel the need for something fancy, the system can be reconfigured on the fly by mqtt packets ...
-}
+  static StaticJsonDocument<384> doc; // fixed size, no heap churn per message
 
-String macToStr(const uint8_t* mac)
-{
-  String result;
-  for (int i = 0; i < 6; ++i) {
-    result += String(mac[i], 16);
+  if (strcmp(topic, cmdTopic) != 0) return;
+  if (deserializeJson(doc, payload, length) != DeserializationError::Ok) {
+    LOG.println("mqtt: invalid config json");
+    return;
   }
-  return result;
-}
 
-/********************************** START RECONNECT*****************************************/
-void reconnect() {
-
-  if (WiFi.status() != WL_CONNECTED) return;
-
-  int nCount = 0;
-
-  // Loop 10 times and then reboot
-  LOG.print("Attempting MQTT connection...");
-  client.setServer(mqtt_server, mqtt_port);
-  client.setCallback(callback);
-
-  while (!client.connected()) {
-    LOG.print(".");
-    delay(5000);
-
-    String ClientId = "SerialMonitor_";
-    unsigned char mac[6];
-    WiFi.macAddress(mac);
-    ClientId += macToStr(mac);
+  int32_t baud = doc["baud"] == "auto" ? 0 : doc["baud"] | -1;
+  int32_t baud2 = doc["baud2"] == "auto" ? 0 : doc["baud2"] | -1;
+  int font = doc["font"] | -1;
+  int orientation = doc["orientation"] | -1;
+
+  if (baud == 0 || (baud >= INGEST_MIN_BAUD && baud <= INGEST_MAX_BAUD)) remoteConfig.baud = baud;
+  if (baud2 == 0 || (baud2 >= INGEST_MIN_BAUD && baud2 <= INGEST_MAX_BAUD)) remoteConfig.baud2 = baud2;
+  if (font >= 1 && font <= 4) remoteConfig.font = font;
+  if (orientation == 0 || orientation == 1) remoteConfig.orientation = orientation;
+  if (doc["pause"].is<bool>()) remoteConfig.pause = doc["pause"].as<bool>();
+  if (doc["stamps"].is<bool>()) remoteConfig.stamps = doc["stamps"].as<bool>();
+  if (doc["filter"].is<const char *>()) {
+    strlcpy(remoteConfig.filter, doc["filter"].as<const char *>(), sizeof(remoteConfig.filter));
+    remoteConfig.filterSet = true;
+  }
+  remoteConfig.pending = true;
+}
 
-    // Attempt to connect
-    if (client.connect(ClientId.c_str())) {
-      LOG.println("connected");
-      //client.subscribe(your_topic);
-    } else {
-      LOG.print("failed, rc=");
-      LOG.print(client.state());
-      LOG.println(" trying again in 5 seconds");
-      // Wait 5 seconds before retrying
-      delay(5000);
-    }
+// log the state of the mqtt connection whenever it changes
+void reportMqtt() {
+  static MqttLink::State last = MqttLink::MQTT_OFFLINE;
+  MqttLink::State now = mqtt.state();
 
-    nCount ++;
-    if ( nCount > 10) ESP.restart();
-  }
+  if (now == last) return;
+  if (now == MqttLink::MQTT_CONNECTED) LOG.printf("mqtt connected as %s\n", mqtt.clientId());
+  else if (last == MqttLink::MQTT_CONNECTED) LOG.printf("mqtt connection lost, rc=%d\n", mqtt.client().state());
+  last = now;
 }
 
-// hardware scrolling only works in portrait mode - a shame ...
+// hardware scrolling only works in portrait mode - a shame ... landscape is redrawn from the text row model
 void setupScrollArea(uint16_t TFA, uint16_t BFA) {
   tft.writecommand(0x33); // Vertical scroll definition
   tft.writedata(TFA >> 8);
@@ -307,133 +418,114 @@ void scrollAddress(uint16_t vsp) {
   tft.writedata(vsp);
 }
 
-void setup(void) {
-  LOG.begin(230400); // use fastest serial speed - also initializes serial0 port with 230400
-  Serial2.begin(9600); // start with 9600 baud
-
+// line sprite and wrap width have to follow font and orientation changes
+// pixels taken by the stamp in front of a line, all line fonts are monospaced
+uint16_t stampWidth() {
+  if (!showStamps) return 0;
+  const uint8_t *adv = lineOut.advances();
+  return (CLOCK_STAMP_CHARS + 1) * (adv ? adv['0' - LINE_FIRST_CHAR] : 6);
+}
 
-  if (!SPIFFS.begin()) {
-    LOG.println("error opening file system. STOP.");
-    while(1);
+// row line[from, to) as it goes on screen: the first row of a line with its receive time in front when enabled,
+// a following one with the colour that was active where it starts
+const char *rowText(const char *line, size_t from, size_t to, int64_t stamp, size_t *outLen) {
+  static char buf[CLOCK_STAMP_CHARS + 3 + LINE_MAX_CHARS];
+  size_t n = 0;
+
+  if (from == 0 && showStamps) {
+    n = lineClock.format(stamp, buf, CLOCK_STAMP_CHARS + 1);
+    buf[n++] = ' ';
+  } else if (from > 0) {
+    uint8_t colour = layoutColour(line, from);
+    if (colour) buf[n++] = LINE_COLOUR_MARKER + colour;
   }
-
-  // read Secrets from local filesystem
-  if (SPIFFS.exists(STORAGE_FILE)) {
-      File f = SPIFFS.open(STORAGE_FILE, "r");
-      if (f) {
-        if (f.readBytes((char *)strSecrets, 100) != 100) {
-          LOG.println("secrets file read error ! STOP."); 
-          while(1);
-        }
-        else {
-          LOG.println("secrets read successfully ...");
-          
-          LOG.print("SSID: ");
-          LOG.println(strSecrets[0]);
-          
-          LOG.print("PASSWORD: ");
-          LOG.println(strSecrets[1]);
-          
-          LOG.print("MQTT SERVER: ");
-          LOG.println(strSecrets[2]);
-          
-          LOG.print("MQTT USERNAME: ");
-          LOG.println(strSecrets[3]);
-          
-          LOG.print("MQTT PASSWORD: ");
-          LOG.println(strSecrets[4]);
-        }
-        f.close();
-      } else {
-        LOG.println("error opening secrets file. STOP.");
-        while(1);
-      }
+  if (n == 0) {
+    *outLen = to - from;
+    return line + from;
   }
-  
-  pinMode(TFT_BL, OUTPUT); // switch Display LED on
-  digitalWrite(TFT_BL, DISPLAY_ON);
-
-  pinMode(21, INPUT_PULLUP); // pause switch pin setup
+  memcpy(buf + n, line + from, to - from);
+  *outLen = n + to - from;
+  return buf;
+}
 
-  tft.init();
-  tft.setRotation(0); //portrait orientation
-  touch_calibrate();
+void setupLineRendering() {
+  if (tft.getRotation() == 1) lineOut.setScrollArea(0, INT16_MAX); // no hardware scroll in landscape
+  else lineOut.setScrollArea(TOP_FIXED_AREA, YMAX - BOT_FIXED_AREA);
+  lineOut.begin(XMAX, TEXT_HEIGHT, lineFont, layoutAdvances((LayoutFont)(fontsize - 1)));
+  layout.begin(lineOut.advances(), XMAX - 10 - stampWidth());
+  for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+    channel[ch].lines.setAdvances(lineOut.advances());
+    channel[ch].lines.setWrapWidth(XMAX - 10 - stampWidth());
+    channel[ch].lines.next();
+    channel[ch].lineStarted = false;
+  }
+  screenRows.begin((YMAX - TOP_FIXED_AREA - BOT_FIXED_AREA) / TEXT_HEIGHT);
+}
 
-  setup_wifi();
-  client.setServer(mqtt_server, mqtt_port);
-  client.setCallback(callback);
-  //OTA SETUP
-  ArduinoOTA.setPort(OTAport);
-  // Hostname defaults to esp8266-[ChipID]
-  ArduinoOTA.setHostname(SENSORNAME);
+// raw bridge clients write back to the target
+void rawToTarget(const uint8_t *data, size_t len) {
+  serialIn.write(data, len);
+}
 
-  // No authentication by default, so we set a password
-  ArduinoOTA.setPassword((const char *)OTApassword);
+void rawToTarget2(const uint8_t *data, size_t len) {
+  serialIn2.write(data, len);
+}
 
-  ArduinoOTA.onStart([]() {
-    LOG.println("Starting");
-  });
-  ArduinoOTA.onEnd([]() {
-    LOG.println("\nEnd");
-  });
-  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-  });
-  ArduinoOTA.onError([](ota_error_t error) {
-    LOG.printf("Error[%u]: ", error);
-    if (error == OTA_AUTH_ERROR) {
-      LOG.println("Auth Failed");
-    }
-    else if (error == OTA_BEGIN_ERROR) {
-      LOG.println("Begin Failed");
-    }
-    else if (error == OTA_CONNECT_ERROR) {
-      LOG.println("Connect Failed");
-    }
-    else if (error == OTA_RECEIVE_ERROR) {
-      LOG.println("Receive Failed");
+// commands typed on the telnet data ports, one per line. only "filter <rules>" so far, applied like the mqtt
+// settings by applyRemoteConfig()
+void telnetCommand(const uint8_t *data, size_t len) {
+  static char cmd[FILTER_SPEC_MAX + 8];
+  static size_t n = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    char c = data[i];
+    if (c != '\r' && c != '\n') {
+      if (c >= ' ' && c < 127 && n < sizeof(cmd) - 1) cmd[n++] = c;
+      continue;
     }
-    else if (error == OTA_END_ERROR) {
-      LOG.println("End Failed");
+    if (n == 0) continue;
+    cmd[n] = 0;
+    n = 0;
+    if (strcmp(cmd, "filter") == 0 || strncmp(cmd, "filter ", 7) == 0) {
+      strlcpy(remoteConfig.filter, cmd[6] ? cmd + 7 : "", sizeof(remoteConfig.filter));
+      remoteConfig.filterSet = true;
+      remoteConfig.pending = true;
     }
-    delay(1000);
-    ESP.restart();
-  });
-  ArduinoOTA.begin();
-
-  LOG.setPort(24);
-  LOG.setWelcomeMsg("Serial Logger\n\n");
-  LOG.setDebugOutput(false);
-
-  tft.fillScreen(TFT_BLACK);
-  tft.setTextColor(TFT_WHITE);
-  tft.setCursor(4,0);
-  tft.setTextFont(1);
-  TEXT_HEIGHT = tft.fontHeight(1)+1;
-  tft.print("ready...9600 baud");
-
-  setupScrollArea(TOP_FIXED_AREA, BOT_FIXED_AREA);
-
-  if(digitalRead(21) == LOW) {
-    tft.setFreeFont(FMB24);
-    tft.setCursor(20,80);
-    tft.setTextColor(TFT_RED);
-    tft.print("ATTENTION: \nPAUSE \nTRIGGERED!");
-
-    while(digitalRead(21) == LOW);
+  }
+}
 
-    tft.fillScreen(TFT_BLACK);
-    tft.setCursor(20,80);
-    tft.setTextColor(TFT_GREEN);
-    tft.println("CONTINUE...");
+// scrollback arena - large in psram if the board has it, otherwise a bounded chunk of internal ram
+void setupHistory() {
+  size_t bytes = HISTORY_RAM_BYTES;
+  uint32_t blocks = HISTORY_RAM_BLOCKS;
+  uint8_t *arena = nullptr;
+  LineHistory::Block *index = nullptr;
+
+  if (psramFound()) {
+    arena = (uint8_t *)ps_malloc(HISTORY_PSRAM_BYTES);
+    index = (LineHistory::Block *)ps_malloc(HISTORY_PSRAM_BLOCKS * sizeof(LineHistory::Block));
+    bytes = HISTORY_PSRAM_BYTES;
+    blocks = HISTORY_PSRAM_BLOCKS;
+  }
+  if (arena == nullptr || index == nullptr) {
+    free(arena);
+    free(index);
+    bytes = HISTORY_RAM_BYTES;
+    blocks = HISTORY_RAM_BLOCKS;
+    arena = (uint8_t *)malloc(bytes);
+    index = (LineHistory::Block *)malloc(blocks * sizeof(LineHistory::Block));
+  }
 
-    tft.setTextColor(TFT_WHITE);
-    tft.setTextFont(1);  
-    delay(1000);
-    tft.fillScreen(TFT_BLACK);
+  if (history.begin(arena, bytes, index, blocks)) {
+    LOG.printf("history: %u kb, %u blocks of %u bytes\n", (unsigned)(bytes / 1024), (unsigned)blocks,
+               (unsigned)HISTORY_BLOCK_BYTES);
+  } else {
+    LOG.println("history: out of memory, scrollback disabled");
   }
 }
 
-int configMenu(int orientation)
+// full draw of the config menu, from then on buttons are only redrawn when their pressed state changes
+void drawMenu()
 {
   tft.fillScreen(TFT_BLACK);
   tft.setRotation(1);
@@ -487,170 +579,910 @@ int configMenu(int orientation)
 
   key[11].initButton(&tft, 419, 235, 75,40, TFT_WHITE, keyColor[11], TFT_WHITE, keyLabel[11], 1);
   key[11].drawButton();
+}
+
+// portrait only - landscape has no hardware scroll and is redrawn from screenRows
+int scroll_line() {
+  int64_t t0 = esp_timer_get_time();
+  lineOut.flush();
+
+  // one scroll command per line: rows wrap modulo the scroll area, so a row may straddle its end - the line
+  // renderer splits its push there. the new row is cleared by the first push of the next line
+  uint16_t area = YMAX - TOP_FIXED_AREA - BOT_FIXED_AREA;
+  uint16_t row = (yPos - TOP_FIXED_AREA + TEXT_HEIGHT) % area;
+
+  if (scrollActive || row + TEXT_HEIGHT > area) {
+    scrollActive = true;
+    yStart = TOP_FIXED_AREA + (row + TEXT_HEIGHT) % area; // new row becomes the bottom line
+    scrollAddress(yStart);
+  }
+  stats.count(STAT_SCROLL_US, esp_timer_get_time() - t0);
+  return TOP_FIXED_AREA + row;
+}
 
-  uint16_t t_x = 0, t_y = 0; // To store the touch coordinates
+// every text line goes through here, so the status bar can show the render time
+void renderText(const char *text, size_t len, uint16_t y) {
+  int64_t t0 = esp_timer_get_time();
+  lineOut.update(text, len, y);
+  stats.count(STAT_RENDER_US, esp_timer_get_time() - t0);
+}
 
-  long timeout = millis();
-  
+// redraw the landscape rows which changed. while lines are scrolling every row changes, so bursts are
+// coalesced into one redraw per LANDSCAPE_FRAME_MS instead of one per line
+void refreshRows(bool force) {
+  static uint32_t lastFrame = 0;
 
-  while((millis() - timeout) < 10000) {
-    // Pressed will be set true is there is a valid touch on the screen
-    bool pressed = tft.getTouch(&t_x, &t_y);
+  if (screenRows.scrolled() && !force) {
+    if (millis() - lastFrame < LANDSCAPE_FRAME_MS) return;
+    lastFrame = millis();
+    screenRows.clearScrolled();
+  }
 
-    // / Check if any key coordinate boxes contain the touch coordinates
-    for (uint8_t b = 0; b < 12; b++) {
-      if (pressed && key[b].contains(t_x, t_y)) {
-        key[b].press(true);  // tell the button it is pressed
-      } else {
-        key[b].press(false);  // tell the button it is NOT pressed
+  for (uint8_t i = 0; i < screenRows.rows(); i++) {
+    if (!screenRows.changed(i)) continue;
+
+    const char *text;
+    size_t len = screenRows.row(i, &text);
+    lineOut.newLine();
+    lineOut.setColour(screenRows.colour(i));
+    renderText(text, len, TOP_FIXED_AREA + i * TEXT_HEIGHT);
+    screenRows.markDrawn(i);
+    stats.count(STAT_RENDERED);
+  }
+}
+
+// clear the screen and draw all rows of screenRows from the top, in portrait the hardware scroll starts over
+void paintRows() {
+  lineOut.flush();
+  if (tft.getRotation() == 0) {
+    yStart = TOP_FIXED_AREA;
+    scrollActive = false;
+    scrollAddress(yStart);
+  }
+  tft.fillScreen(TFT_BLACK);
+  statusDirty = true;
+  screenRows.invalidate();
+  refreshRows(true);
+}
+
+// a finished row: portrait scrolls the hardware window, landscape only records it in the row model
+void showRow(uint8_t ch, const char *line, size_t from, size_t to, uint16_t colour, bool redraw) {
+  size_t len;
+  const char *text = rowText(line, from, to, channel[ch].lineStamp, &len);
+
+  if (tft.getRotation() == 1) {
+    screenRows.commit(text, len, colour);
+    return;
+  }
+  // the open row shows the other channel or a word that moved on to the next row, draw over it from scratch
+  if (ch != openOwner || redraw) lineOut.newLine();
+  uint16_t yLine = yPos;
+  yPos = scroll_line();
+  lineOut.setColour(colour);
+  renderText(text, len, yLine); // rest of the finished line goes out by dma ...
+  lineOut.newLine();            // ... while the next one is drawn
+  stats.count(STAT_RENDERED);
+}
+
+// a row of a channel is complete. with filter rules a line is judged as a whole, so its rows only show up once
+// the line is complete - laid out like the history lines, seq is its history entry
+void showLine(uint8_t ch, uint32_t seq) {
+  Channel &c = channel[ch];
+
+  if (lineFilter.rules() == 0) {
+    if (c.lines.length() > 0 || c.lines.rowStart() == 0) { // not the empty rest after a row ending in a space
+      showRow(ch, c.lines.line(), c.lines.rowStart(), c.lines.rowStart() + c.lines.length(), c.colour,
+              c.lines.wrapped());
+    }
+    return;
+  }
+
+  bool highlight;
+  if (c.lines.wrapped() || !lineFilter.accept(c.lines.line(), c.lines.lineLength(), &highlight)) return;
+  const LineLayout &l = layout.get(seq, c.lines.line(), c.lines.lineLength());
+  for (uint8_t r = 0; r < l.rows; r++) {
+    showRow(ch, c.lines.line(), l.begin(r), l.finish(r), highlight ? HIGHLIGHT_COLOUR : c.colour, true);
+  }
+}
+
+// the incomplete line of a channel, e.g. a prompt. the open row sticks to one channel until its line is
+// finished, the other channel's partial line only shows up once it is complete. with filter rules a line is
+// only shown once it is complete and passed the filter, the open row stays empty
+void showOpenLine(uint8_t ch) {
+  if (ch != openOwner) {
+    if (channel[openOwner].lines.length() > 0) return;
+    openOwner = ch;
+    if (tft.getRotation() == 0) lineOut.newLine();
+  }
+
+  Channel &c = channel[ch];
+  size_t len = 0;
+  const char *text = "";
+  if (c.lineStarted && lineFilter.rules() == 0) {
+    text = rowText(c.lines.line(), c.lines.rowStart(), c.lines.rowStart() + c.lines.length(), c.lineStamp, &len);
+  }
+
+  if (tft.getRotation() == 1) {
+    screenRows.setOpen(text, len, c.colour);
+  } else {
+    lineOut.setColour(c.colour);
+    renderText(text, len, yPos);
+  }
+}
+
+// fill screenRows with the rows of the history lines before end which pass the filter, the last row stays open.
+// only these lines are laid out right away, the ones above follow with relayoutStep()
+void loadRows(uint32_t end) {
+  uint16_t rows = screenRows.rows() - 1;
+  uint16_t found = 0;
+  uint32_t from = end;
+  const char *text;
+  size_t len;
+  bool highlight;
+
+  while (found < rows && from != history.first()) {
+    from--;
+    if (history.get(from, &text, &len) && lineFilter.accept(text, len, &highlight)) {
+      found += layout.get(from, text, len).rows;
+    }
+  }
+  uint16_t skip = found > rows ? found - rows : 0; // top rows of the first line which do not fit
+  viewStart = from;
+  viewPartial = skip > 0;
+  relayoutNext = from;
+  relayoutLeft = LAYOUT_CACHE_LINES / 2;
+
+  screenRows.begin(screenRows.rows());
+  for (uint32_t seq = from; seq < end; seq++) {
+    int64_t stamp;
+    uint8_t ch;
+    if (!history.get(seq, &text, &len, &stamp, &ch) || !lineFilter.accept(text, len, &highlight)) continue;
+
+    uint16_t colour = highlight ? HIGHLIGHT_COLOUR : ch < CHANNELS ? channel[ch].colour : ROW_DEFAULT_COLOUR;
+    const LineLayout &l = layout.get(seq, text, len);
+    for (uint8_t r = 0; r < l.rows; r++) {
+      if (skip > 0) {
+        skip--;
+        continue;
       }
+      size_t n;
+      const char *row = rowText(text, l.begin(r), l.finish(r), stamp, &n);
+      screenRows.commit(row, n, colour);
     }
+  }
+}
 
-    // Check if any key has changed state
-    for (uint8_t b = 0; b < 12; b++) {
-      if (key[b].justReleased()) key[b].drawButton();     // draw normal
+// lay out a few history lines above the screen per loop pass, so paging back after a font or orientation
+// change finds them in the cache
+void relayoutStep() {
+  const char *text;
+  size_t len;
 
-      if (key[b].justPressed()) {
-        key[b].drawButton(true);  // draw invert
+  for (uint8_t i = 0; i < LAYOUT_STEP && relayoutLeft > 0; i++, relayoutLeft--) {
+    if ((int32_t)(relayoutNext - history.first()) <= 0) {
+      relayoutLeft = 0;
+      break;
+    }
+    relayoutNext--;
+    if (history.get(relayoutNext, &text, &len)) layout.get(relayoutNext, text, len);
+  }
+}
 
-        if (b < 3) {
-          fontsize = b +1;
-          return orientation;
-        }
-        if (b == 3) {
-          orientation = 1; 
-          return orientation;
-        }
-        if (b == 4) {
-          orientation = 0;  
-          return orientation;
-        }
-        if (b == 5) {
-          return orientation;
-        }
-        if (b > 5) {
-          serialspeed = b - 5;
-          return orientation;
-        }
-        delay(10);
+// show the history page ending before sequence number end, capture goes on into the history meanwhile
+void showHistory(uint32_t end) {
+  char status[48];
+
+  viewingHistory = true;
+  viewEnd = end;
+  loadRows(end);
+  int len = snprintf(status, sizeof(status), "-- history -%u, tap: live --", (unsigned)(history.end() - end));
+  screenRows.setOpen(status, len);
+  paintRows();
+}
+
+// back to the live lines: the last screenful is redrawn from the history instead of replaying the input
+void showLive() {
+  viewingHistory = false;
+  loadRows(history.end());
+  showOpenLine(openOwner);
+  paintRows();
+
+  if (tft.getRotation() == 0) { // continue incremental drawing on the open row
+    yPos = TOP_FIXED_AREA + screenRows.openRow() * TEXT_HEIGHT;
+    lineOut.newLine();
+    showOpenLine(openOwner);
+  }
+}
+
+// the target erased its display (ESC[2J): the live screen starts over empty, the history keeps everything
+void clearLive() {
+  screenRows.begin(screenRows.rows());
+  paintRows();
+  if (tft.getRotation() == 0) {
+    yPos = TOP_FIXED_AREA + screenRows.openRow() * TEXT_HEIGHT;
+    lineOut.newLine();
+  }
+}
+
+// dir < 0 pages to older lines, dir > 0 to newer ones and finally back to live. a page is a screenful of rows,
+// a line cut at the top of the screen is shown in full at the bottom of the older page
+void pageHistory(int dir) {
+  uint16_t page = screenRows.rows() - 1;
+  const char *text;
+  size_t len;
+  bool highlight;
+
+  if (dir < 0) {
+    if (!viewingHistory) loadRows(history.end()); // live lines kept scrolling in since the last repaint
+    uint32_t end = viewPartial ? viewStart + 1 : viewStart;
+    if (end == (viewingHistory ? viewEnd : history.end())) end = viewStart; // one line taller than the screen
+    if ((int32_t)(end - history.first()) <= 0) return; // nothing older
+    showHistory(end);
+  } else if (viewingHistory) {
+    uint32_t end = viewEnd;
+    for (uint16_t found = 0; found < page && end != history.end(); end++) {
+      if (history.get(end, &text, &len) && lineFilter.accept(text, len, &highlight)) {
+        found += layout.get(end, text, len).rows;
       }
     }
+    if (end == history.end()) showLive();
+    else showHistory(end);
   }
-return orientation;
 }
 
-int scroll_line() {
-  int yTemp = yStart;
+// the encoder moves the history by lines shown on screen, lines < 0 towards older ones. the page ends before the
+// line reached, turning on past the newest line returns to live
+void scrollHistory(int32_t lines) {
+  uint32_t end = viewingHistory ? viewEnd : history.end();
+  const char *text;
+  size_t len;
+  bool highlight;
+
+  if (!viewingHistory && lines > 0) return;
+  for (; lines < 0; lines++) { // hide the newest line on the page
+    uint32_t seq = end;
+    while ((int32_t)(seq - history.first()) > 0) {
+      seq--;
+      if (history.get(seq, &text, &len) && lineFilter.accept(text, len, &highlight)) break;
+    }
+    if (seq == end || (int32_t)(seq - history.first()) <= 0) break; // nothing older
+    end = seq;
+  }
+  for (; lines > 0 && end != history.end(); lines--) { // bring in the next one
+    while (end != history.end() && !(history.get(end, &text, &len) && lineFilter.accept(text, len, &highlight))) end++;
+    if (end != history.end()) end++;
+  }
 
-  if (tft.getRotation() == 1) {
-    yStart += TEXT_HEIGHT;
-    if (yStart >= (YMAX - BOT_FIXED_AREA)) {
-      yStart = TOP_FIXED_AREA + fontOffset;
-      tft.fillScreen(TFT_BLACK);
+  if (end == history.end()) showLive();
+  else if (!viewingHistory || end != viewEnd) showHistory(end);
+}
+
+// the receive time of a new line is looked up when its first byte is taken from the ring
+void startLine(Channel &c, uint32_t pos) {
+  char stamp[24];
+
+  c.lineStamp = c.in->lineStamp(pos);
+  c.lineStarted = true;
+  size_t n = lineClock.format(c.lineStamp, stamp, sizeof(stamp) - 1, 6);
+  stamp[n++] = ' ';
+  c.telnet->write((const uint8_t *)stamp, n);
+}
+
+// printable bytes go out to the telnet clients in one chunk, ESC as well so terminals show the target's colours
+void forwardTelnet(StreamServer &out, const uint8_t *data, size_t len) {
+  uint8_t buf[128];
+  size_t n = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    if ((data[i] > 31 && data[i] < 128) || data[i] == 0x1b) buf[n++] = data[i];
+    if (n == sizeof(buf)) {
+      out.write(buf, n);
+      n = 0;
     }
-    yTemp = yStart;
-  } else {
-    for (int i = 0; i < TEXT_HEIGHT; i++) {
-      yStart++;
-      if (yStart == (YMAX - BOT_FIXED_AREA)) {
-        yStart = TOP_FIXED_AREA + fontOffset;
+  }
+  if (n > 0) out.write(buf, n);
+}
+
+// log lost bytes once per second, only when a counter actually moved
+void reportOverruns() {
+  static uint32_t lastReport = 0;
+  static uint32_t lastLost[CHANNELS] = {0};
+
+  if (millis() - lastReport < 1000) return;
+  lastReport = millis();
+
+  for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+    IngestStats s = channel[ch].in->stats();
+    uint32_t lost = s.fifoOverflows + s.driverFull + s.ringDropped;
+    if (lost != lastLost[ch]) {
+      LOG.printf("\n[rx overrun on channel %u: fifo %u, driver %u, ring %u bytes]\n", ch + 1, s.fifoOverflows,
+                 s.driverFull, s.ringDropped);
+      lastLost[ch] = lost;
+    }
+  }
+}
+
+// the running settings become the boot settings, nvs is only written when one of them changed
+void saveSettings() {
+  settings.baud[0] = serialIn.baudrate();
+  settings.baud[1] = serialIn2.baudrate();
+  settings.font = fontsize;
+  settings.orientation = menuOpen ? menuOrientation : tft.getRotation();
+  settings.stamps = showStamps;
+  strlcpy(settings.filter, lineFilter.spec(), sizeof(settings.filter));
+  if (!settingsStore.save(settings)) LOG.println("settings: nvs write failed");
+}
+
+// finish a running auto baud measurement, the detected rate is already set when it is reported - and saved, so
+// the next boot starts with it
+void pollAutoBaud() {
+  for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+    if (!channel[ch].in->autoBaudActive()) continue;
+    uint32_t baud = channel[ch].in->pollAutoBaud();
+    if (baud) {
+      LOG.printf("channel %u: detected %u baud\n", ch + 1, (unsigned)baud);
+      saveSettings();
+    }
+  }
+}
+
+// take what the ingest task of one channel has collected and feed it through the line pipeline
+void drainChannel(uint8_t ch, bool frozen) {
+  Channel &c = channel[ch];
+  const uint8_t *chunk;
+  size_t len;
+  size_t budget = RX_LOOP_BUDGET;
+
+  while (budget > 0 && (len = c.in->ring().peek(&chunk)) > 0) {
+    if (len > budget) len = budget;
+
+    c.raw->write(chunk, len); // unfiltered, straight from the ingest ring
+
+    const uint8_t *p = chunk;
+    size_t left = len;
+
+    while (left > 0) {
+      if (!c.lineStarted) startLine(c, c.in->ring().readPos() + (p - chunk));
+      size_t n = c.lines.feed(p, left);
+      forwardTelnet(*c.telnet, p, n);
+      if (c.lines.takeClear() && !frozen) clearLive();
+      if (c.lines.takeErase() && !frozen && ch == openOwner && tft.getRotation() == 0) lineOut.newLine();
+
+      // a row is full or the line ended with CR: scroll one row, the history takes the whole line
+      if (c.lines.complete()) {
+        bool lineEnd = !c.lines.wrapped();
+        uint32_t seq = 0;
+        if (lineEnd) {
+          seq = history.append(c.lines.line(), c.lines.lineLength(), c.lineStamp, ch);
+          stats.count(STAT_LINES);
+        }
+        if (!frozen) showLine(ch, seq);
+        c.lines.next();
+        if (lineEnd) {
+          c.lineStarted = false;
+          c.telnet->write("\r\n");
+        }
       }
-      scrollAddress(yStart);
+      p += n;
+      left -= n;
     }
-    tft.fillRect(0,yTemp,XMAX,TEXT_HEIGHT, TFT_BLACK);
+    if (!frozen) showOpenLine(ch);
+    c.in->ring().consume(len);
+    budget -= len;
   }
-  return yTemp;
 }
 
-void loop(void) {
-  if (WiFi.status() != WL_CONNECTED) {
-    delay(1);
-    LOG.print("WIFI disconnected. Attempting reconnection.");
-    setup_wifi();
-    return;
+// switch orientation and font (fontsize), the screen starts over empty
+void applyDisplaySettings(int newOrientation) {
+  tft.fillScreen(TFT_BLACK);
+  statusDirty = true;
+  tft.setTextColor(TFT_WHITE);
+  tft.setCursor(4,fontOffset);
+
+  switch(newOrientation) {
+    case 0: // hardware scroll in portrait mode
+      tft.setRotation(newOrientation);
+      XMAX=320;
+      YMAX=480;
+      yStart = yPos = TOP_FIXED_AREA;
+      scrollActive = false;
+      setupScrollArea(TOP_FIXED_AREA, BOT_FIXED_AREA);
+      break;
+
+    case 1: // software scrolling from the row model in landscape mode
+      tft.setRotation(newOrientation);
+      XMAX=480;
+      YMAX=320;
+      yStart = yPos = TOP_FIXED_AREA;
+      scrollActive = false;
+      break;
   }
+  switch(fontsize) {
+    case 1: tft.setTextFont(1);TEXT_HEIGHT = tft.fontHeight(1)+1;fontOffset = 0;lineFont = nullptr;break;
+    case 2: tft.setFreeFont(FM9);TEXT_HEIGHT = 15;fontOffset = 10;lineFont = FM9;break;
+    case 3: tft.setFreeFont(FM12);TEXT_HEIGHT = 18;fontOffset = 18;lineFont = FM12;break;
+    case 4: tft.setFreeFont(FM24);TEXT_HEIGHT = 30;fontOffset = 32;lineFont = FM24;break;
+  }
+  setupLineRendering();
+  viewingHistory = false;
+}
+
+// the uarts are only reconfigured when the selected rate differs from the running one
+void applyMenuBaud() {
+  uint32_t baudrate = menuBaud[serialspeed - 1];
 
-  if (!client.connected()) {
-    reconnect();
+  for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+    UartIngest *in = channel[ch].in;
+    if (baudrate == 0) in->startAutoBaud();
+    else if (baudrate != in->baudrate()) in->setBaudrate(baudrate);
   }
+  if (baudrate == 0) LOG.println("menu: auto baud");
+  else LOG.printf("menu: %u baud\n", (unsigned)baudrate);
+}
 
-  client.loop();
-  ArduinoOTA.handle();
-  LOG.handle();
+void closeMenu(int orientation, bool speedSelected) {
+  menuOpen = false;
+  applyDisplaySettings(orientation);
+  if (speedSelected) applyMenuBaud();
+  showLive();
+  saveSettings();
+}
 
-  uint16_t x,y;
+void menuSelect(uint8_t b) {
+  int orientation = menuOrientation;
 
-  if( tft.getTouch(&x,&y)) {
-    int orientation = tft.getRotation();
-    int newOrientation = configMenu(orientation);
-    tft.fillScreen(TFT_BLACK);
-    tft.setTextColor(TFT_WHITE);
-    tft.setCursor(4,fontOffset);
-
-    switch(newOrientation) {
-      case 0: // hardware scroll in portrait mode
-        tft.setRotation(newOrientation);
-        XMAX=320;
-        YMAX=480;
-        yStart = yPos = TOP_FIXED_AREA;
-        setupScrollArea(TOP_FIXED_AREA, BOT_FIXED_AREA);
-        break;
+  if (b < 3) fontsize = b + 1;
+  if (b == 3) orientation = 1;
+  if (b == 4) orientation = 0;
+  if (b > 5) serialspeed = b - 5;
+  closeMenu(orientation, b > 5);
+}
 
-      case 1: // screen blanking in landscape mode
-        tft.setRotation(newOrientation);
-        XMAX=480;
-        YMAX=320;
-        yStart = yPos = TOP_FIXED_AREA;
-        break;
+// pressed feedback for the button under the finger, releasing it on a button selects that one
+void menuTouch(const TouchEvent &e) {
+  bool down = e.type != TouchEvent::UP;
+
+  menuOpenedAt = millis();
+  for (uint8_t b = 0; b < 12; b++) {
+    bool inside = key[b].contains(e.x, e.y);
+    key[b].press(down && inside);
+    if (key[b].justPressed()) key[b].drawButton(true); // draw invert
+    if (key[b].justReleased()) {
+      if (!down && inside) {
+        menuSelect(b);
+        return;
+      }
+      key[b].drawButton(); // finger slid off the button
     }
-    switch(fontsize) {
-      case 1: tft.setTextFont(1);TEXT_HEIGHT = tft.fontHeight(1)+1;fontOffset = 0;break;
-      case 2: tft.setFreeFont(FM9);TEXT_HEIGHT = 15;fontOffset = 10;break;
-      case 3: tft.setFreeFont(FM12);TEXT_HEIGHT = 18;fontOffset = 18;break;
-      case 4: tft.setFreeFont(FM24);TEXT_HEIGHT = 30;fontOffset = 32;break;
+  }
+}
+
+// the menu is an overlay: capture, history, telnet and mqtt go on underneath, only the display is frozen.
+// the screen is rebuilt from the history when it closes
+void openMenu() {
+  menuOrientation = tft.getRotation();
+  lineOut.flush();
+  drawMenu();
+  menuOpen = true;
+  menuOpenedAt = millis();
+}
+
+// settings from the mqtt command topic. the display is rebuilt from the history, the uart is only touched
+// when the baud rate really changed - capture continues on core 0 throughout
+void applyRemoteConfig() {
+  if (!remoteConfig.pending || menuOpen) return; // applied once the menu is closed
+  remoteConfig.pending = false;
+
+  if (remoteConfig.baud == 0) serialIn.startAutoBaud();
+  else if (remoteConfig.baud > 0 && (uint32_t)remoteConfig.baud != serialIn.baudrate()) {
+    serialIn.setBaudrate(remoteConfig.baud);
+  }
+  if (remoteConfig.baud2 == 0) serialIn2.startAutoBaud();
+  else if (remoteConfig.baud2 > 0 && (uint32_t)remoteConfig.baud2 != serialIn2.baudrate()) {
+    serialIn2.setBaudrate(remoteConfig.baud2);
+  }
+  if (remoteConfig.pause >= 0) remotePause = remoteConfig.pause;
+
+  bool refilter = false;
+  if (remoteConfig.filterSet) {
+    refilter = lineFilter.compile(remoteConfig.filter);
+    if (!refilter) LOG.printf("filter rules rejected: %s\n", remoteConfig.filter);
+  }
+
+  int orientation = remoteConfig.orientation >= 0 ? remoteConfig.orientation : tft.getRotation();
+  if (orientation != tft.getRotation() || (remoteConfig.font > 0 && remoteConfig.font != fontsize) ||
+      (remoteConfig.stamps >= 0 && remoteConfig.stamps != showStamps)) {
+    if (remoteConfig.font > 0) fontsize = remoteConfig.font;
+    if (remoteConfig.stamps >= 0) showStamps = remoteConfig.stamps;
+    applyDisplaySettings(orientation);
+    showLive();
+  } else if (refilter) { // the screen is rebuilt from the history with the new rules
+    if (viewingHistory) showHistory(viewEnd);
+    else showLive();
+  }
+  remoteConfig = {-1, -1, -1, -1, -1, -1, false};
+  saveSettings();
+
+  StaticJsonDocument<384> doc;
+  char json[384];
+  doc["baud"] = serialIn.baudrate();
+  doc["baud2"] = serialIn2.baudrate();
+  doc["font"] = fontsize;
+  doc["orientation"] = tft.getRotation();
+  doc["pause"] = remotePause;
+  doc["stamps"] = showStamps;
+  doc["filter"] = lineFilter.spec();
+  size_t n = serializeJson(doc, json, sizeof(json));
+  mqtt.client().publish(statusTopic, (const uint8_t *)json, n);
+  LOG.printf("config applied: %s\n", json);
+}
+
+// swipes page through the history, a tap opens the config menu (or returns from scrollback to live).
+// while the menu is open all touch events go to it
+void handleTouch() {
+  static uint16_t startY = 0;
+  static uint16_t lastY = 0;
+  TouchEvent e;
+
+  if (menuOpen && millis() - menuOpenedAt >= MENU_TIMEOUT_MS) closeMenu(menuOrientation, false);
+
+  while (touch.read(&e)) {
+    if (menuOpen) {
+      menuTouch(e);
+      continue;
     }
-    
-    int baudrate = 115200;
-
-    switch(serialspeed) {
-      case 1: baudrate = 9600;break;
-      case 2: baudrate = 19200;break;
-      case 3: baudrate = 38400;break;
-      case 4: baudrate = 57600;break;
-      case 5: baudrate = 115200;break;
-      case 6: baudrate = 230400;break;
+    if (e.type == TouchEvent::DOWN) startY = e.y;
+    lastY = e.y;
+    if (e.type != TouchEvent::UP) continue;
+
+    int dy = (int)lastY - (int)startY;
+    if (dy > SWIPE_MIN) pageHistory(-1);      // finger moved down: older lines
+    else if (dy < -SWIPE_MIN) pageHistory(1); // finger moved up: newer lines
+    else if (viewingHistory) showLive();
+    else openMenu();
+  }
+}
+
+// the pause switch only freezes the display. capture continues into the history and to telnet, on resume
+// the last screenful is redrawn from the history instead of replaying everything that came in
+bool displayPaused() {
+  static bool paused = false;
+  static uint32_t pausedAt = 0;
+  bool now = digitalRead(21) == LOW || remotePause;
+
+  if (now && !paused) pausedAt = history.end();
+  if (!now && paused && !viewingHistory && history.end() != pausedAt) showLive();
+  paused = now;
+  return paused;
+}
+
+// the mark button: a numbered separator line in the history - so on screen, on the sd card and in mqtt - and on
+// the telnet port of the main channel, where a line in progress goes on after it with its stamp repeated
+void insertMark() {
+  static uint16_t marks = 0;
+  Channel &c = channel[0];
+  char text[32];
+  char stamp[24];
+  int64_t now = esp_timer_get_time();
+
+  int len = snprintf(text, sizeof(text), "----- mark %u -----", (unsigned)++marks);
+  history.append(text, len, now, 0);
+  LOG.printf("panel: %s\n", text);
+
+  if (c.lineStarted) c.telnet->write("\r\n");
+  size_t n = lineClock.format(now, stamp, sizeof(stamp) - 1, 6);
+  stamp[n++] = ' ';
+  c.telnet->write((const uint8_t *)stamp, n);
+  c.telnet->write((const uint8_t *)text, len);
+  c.telnet->write("\r\n");
+  if (c.lineStarted) {
+    n = lineClock.format(c.lineStamp, stamp, sizeof(stamp) - 1, 6);
+    stamp[n++] = ' ';
+    c.telnet->write((const uint8_t *)stamp, n);
+  }
+
+  if (!menuOpen && !viewingHistory && !displayPaused()) showLive();
+}
+
+// expander buttons and encoder detents, whatever came in since the last loop pass. the encoder scrolls as far as
+// it was turned in one repaint
+void handlePanel() {
+  PanelEvent e;
+
+  while (panel.read(&e)) {
+    switch (e.type) {
+      case PanelEvent::PAUSE: remotePause = !remotePause; break; // like {"pause":...} over mqtt
+      case PanelEvent::MARK: insertMark(); break;
+      case PanelEvent::MENU:
+        if (menuOpen) closeMenu(menuOrientation, false);
+        else openMenu();
+        break;
     }
+  }
+  int32_t steps = panel.takeSteps();
+  if (steps != 0 && !menuOpen) scrollHistory(steps);
+}
 
-    Serial2.end();
-    Serial2.begin(baudrate);
+// close the stats interval once per second and show it in the bottom fixed area, which neither the hardware
+// scroll nor the landscape rows touch. the menu covers the whole screen, the bar comes back when it closes
+void updateStats() {
+  static uint32_t lastSample = 0;
+  UartIngest *const inputs[CHANNELS] = {channel[0].in, channel[1].in};
+  char bar[64];
 
-    tft.print("ready...");
-    tft.print(baudrate);
-    tft.println(" baud");
-    delay(500);
+  if (millis() - lastSample < 1000) {
+    if (!statusDirty) return;
+  } else {
+    lastSample = millis();
+    stats.sample(inputs, CHANNELS);
   }
+  if (menuOpen) return;
 
-  byte data = 0;
+  const StatsSnapshot &s = stats.last();
+  lineOut.flush();
+  tft.fillRect(0, YMAX - BOT_FIXED_AREA, XMAX, BOT_FIXED_AREA, STATUS_BAR_COLOUR);
+  tft.setTextFont(1);
+  tft.setTextColor(TFT_WHITE, STATUS_BAR_COLOUR);
+  snprintf(bar, sizeof(bar), "rx %u/%u lost %u ln %u dr %u p99 %u tn %u", (unsigned)s.rxPerSec[0],
+           (unsigned)s.rxPerSec[1], (unsigned)(s.lost[0] + s.lost[1]), (unsigned)s.perSec[STAT_LINES],
+           (unsigned)s.perSec[STAT_RENDERED], (unsigned)s.loopP99Us,
+           (unsigned)(telnet.backlog() > telnet2.backlog() ? telnet.backlog() : telnet2.backlog()));
+  tft.drawString(bar, 2, YMAX - BOT_FIXED_AREA + 1);
+  statusDirty = false;
+}
 
-  while (Serial2.available()) {
-    data = Serial2.read();
+// the last sampled counters as json every STATS_PUBLISH_MS
+void publishStats() {
+  static uint32_t lastPublish = 0;
+
+  if (millis() - lastPublish < STATS_PUBLISH_MS || !mqtt.connected()) return;
+  lastPublish = millis();
+
+  const StatsSnapshot &s = stats.last();
+  StaticJsonDocument<1024> doc;
+  char json[768];
+  JsonArray rx = doc.createNestedArray("rx");
+  JsonArray lost = doc.createNestedArray("lost");
+  for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+    rx.add(s.rxPerSec[ch]);
+    lost.add(s.lost[ch]);
+  }
+  doc["lines"] = s.perSec[STAT_LINES];
+  doc["rendered"] = s.perSec[STAT_RENDERED];
+  doc["render_us"] = s.perSec[STAT_RENDER_US];
+  doc["scroll_us"] = s.perSec[STAT_SCROLL_US];
+  doc["loops"] = s.loops;
+  doc["loop_p99_us"] = s.loopP99Us;
+  doc["loop_max_us"] = s.loopMaxUs;
+  JsonArray hist = doc.createNestedArray("loop_hist");
+  for (uint8_t i = 0; i < STATS_LOOP_BUCKETS; i++) hist.add(s.loopHist[i]);
+  JsonArray tn = doc.createNestedArray("telnet_backlog");
+  for (uint8_t ch = 0; ch < CHANNELS; ch++) tn.add(channel[ch].telnet->backlog());
+  JsonArray skipped = doc.createNestedArray("telnet_skipped");
+  JsonArray shed = doc.createNestedArray("telnet_shed");
+  for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+    skipped.add(channel[ch].telnet->dropped() + channel[ch].raw->dropped());
+    shed.add(channel[ch].telnet->shed() + channel[ch].raw->shed());
+  }
+  doc["mqtt_backlog"] = mqttOut.backlog();
+  doc["sd_backlog"] = sdLog.backlog();
+  doc["history_lines"] = history.size();
+  if (history.packedBytes()) doc["history_ratio"] = (float)history.rawBytes() / history.packedBytes();
+  doc["heap"] = ESP.getFreeHeap();
+  size_t n = serializeJson(doc, json, sizeof(json));
+  mqtt.client().publish(statsTopic, (const uint8_t *)json, n);
+}
 
-    if(digitalRead(21)) { // only show read data when pause switch has not been triggered
-      // If it is a CR or we are near end of line then scroll one line
-      if (data == '\r' || xPos>(XMAX - 10)) {
-        xPos = 0;
-        yPos = scroll_line(); 
-        LOG.println();
-      }
-      if (data > 31 && data < 128) {
-        xPos += tft.drawChar(data,xPos,yPos);
+// capture comes first: the uarts start at the saved rates before the display or the network are touched, the
+// ingest tasks fill the rings from then on. the file system, sd card, wifi, mqtt, telnet and OTA follow after the
+// first loop pass - so the boot output of the target is on screen and in the history meanwhile
+void setup(void) {
+  settingsStore.load(&settings); // one nvs blob, nothing to parse - defaults until settings are saved
+  bool capture = serialIn.begin(UART_NUM_2, RX2_PIN, TX2_PIN, settings.baud[0]); // runs on core 0 from now on
+  bool capture2 = serialIn2.begin(UART_NUM_1, RX1_PIN, TX1_PIN, settings.baud[1], INGEST_RING_SIZE / 2);
+  uint32_t captureStart = millis();
+  LOG.begin(230400); // use fastest serial speed - also initializes serial0 port with 230400
+  if (!capture) LOG.println("serial2 capture failed to start, no memory for the ring or uart driver");
+  if (!capture2) LOG.println("serial1 capture failed to start, no memory for the ring or uart driver");
+  if (!lineFilter.compile(settings.filter)) LOG.println("invalid filter rules, no rules");
+  for (uint8_t i = 0; i < 6; i++) {
+    if (menuBaud[i] == settings.baud[0]) serialspeed = i + 1;
+  }
+  fontsize = settings.font >= 1 && settings.font <= 4 ? settings.font : 1;
+  showStamps = settings.stamps;
+
+  pinMode(TFT_BL, OUTPUT); // switch Display LED on
+  digitalWrite(TFT_BL, DISPLAY_ON);
+
+  pinMode(21, INPUT_PULLUP); // pause switch pin setup
+
+  setupHistory();
+
+  spiBus.begin();
+  tft.init();
+#ifdef USE_DMA_TO_TFT
+  lineOut.enableDma(tft.initDMA()); // double buffered line pushes
+#endif
+  tft.setRotation(0); //portrait orientation
+  touch_calibrate();
+  touch.begin(TOUCH_IRQ);
+  if (panel.beginKnob(ENCODER_A_PIN, ENCODER_B_PIN)) LOG.println("panel: encoder on");
+  Wire.begin(PANEL_SDA_PIN, PANEL_SCL_PIN, 400000);
+  if (panel.beginButtons(&Wire, PANEL_MCP_ADDRESS, PANEL_INT_PIN)) LOG.println("panel: buttons on");
+  else LOG.println("panel: no button expander");
+
+  applyDisplaySettings(settings.orientation == 1 ? 1 : 0);
+  tft.printf("ready...%u baud", (unsigned)serialIn.baudrate());
+  LOG.printf("capturing since %u ms after reset, display up after %u ms\n", (unsigned)captureStart,
+             (unsigned)millis());
+
+  // the pause switch only freezes the display, capture and history go on - nothing to wait for here
+  if(digitalRead(21) == LOW) {
+    tft.setFreeFont(FMB24);
+    tft.setCursor(20,80);
+    tft.setTextColor(TFT_RED);
+    tft.print("ATTENTION: \nPAUSE \nTRIGGERED!");
+    tft.setTextColor(TFT_WHITE);
+    tft.setTextFont(1);
+  }
+}
 
-        char str[2];
-        str[0] = data;
-        str[1] = 0;
-        LOG.print(str);
+// secrets from the file system, then sd card, wifi, mqtt, OTA and the tcp servers - once, from the first loop
+// pass. false if there are no secrets, capture and display then run without the network
+bool startServices() {
+  if (!SPIFFS.begin()) {
+    LOG.println("error opening file system, network disabled");
+    return false;
+  }
+
+  // read Secrets from local filesystem
+  if (SPIFFS.exists(STORAGE_FILE)) {
+      File f = SPIFFS.open(STORAGE_FILE, "r");
+      if (f) {
+        if (f.readBytes((char *)strSecrets, 100) != 100) {
+          LOG.println("secrets file read error, network disabled");
+          f.close();
+          return false;
+        }
+        else {
+          LOG.println("secrets read successfully ...");
+          
+          LOG.print("SSID: ");
+          LOG.println(strSecrets[0]);
+          
+          LOG.print("PASSWORD: ");
+          LOG.println(strSecrets[1]);
+          
+          LOG.print("MQTT SERVER: ");
+          LOG.println(strSecrets[2]);
+          
+          LOG.print("MQTT USERNAME: ");
+          LOG.println(strSecrets[3]);
+          
+          LOG.print("MQTT PASSWORD: ");
+          LOG.println(strSecrets[4]);
+        }
+        f.close();
+      } else {
+        LOG.println("error opening secrets file, network disabled");
+        return false;
       }
+  }
+
+  if (sdLog.begin(SD_CS, &history, &lineClock)) LOG.println("sd: card mounted, logging");
+  else LOG.println("sd: no card, logging disabled");
+
+  wifi.begin(ssid, password, SENSORNAME); // connects in the background
+  lineClock.begin(NTP_SERVER, CLOCK_TZ);
+  mqtt.begin(mqtt_server, mqtt_port, mqtt_username, mqtt_password, callback);
+  snprintf(cmdTopic, sizeof(cmdTopic), "serialmonitor/%s/cmd", mqtt.clientId());
+  snprintf(statusTopic, sizeof(statusTopic), "serialmonitor/%s/status", mqtt.clientId());
+  snprintf(statsTopic, sizeof(statsTopic), "serialmonitor/%s/stats", mqtt.clientId());
+  mqtt.subscribe(cmdTopic);
+  if (!mqttOut.begin(&mqtt, &history, MQTT_MAX_PACKET_SIZE)) LOG.println("mqtt: no memory for batches");
+  mqttOut.setClock(&lineClock);
+  //OTA SETUP
+  ArduinoOTA.setPort(OTAport);
+  // Hostname defaults to esp8266-[ChipID]
+  ArduinoOTA.setHostname(SENSORNAME);
+
+  // No authentication by default, so we set a password
+  ArduinoOTA.setPassword((const char *)OTApassword);
+
+  ArduinoOTA.onStart([]() {
+    LOG.println("Starting");
+  });
+  ArduinoOTA.onEnd([]() {
+    LOG.println("\nEnd");
+  });
+  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
+  });
+  ArduinoOTA.onError([](ota_error_t error) {
+    LOG.printf("Error[%u]: ", error);
+    if (error == OTA_AUTH_ERROR) {
+      LOG.println("Auth Failed");
     }
+    else if (error == OTA_BEGIN_ERROR) {
+      LOG.println("Begin Failed");
+    }
+    else if (error == OTA_CONNECT_ERROR) {
+      LOG.println("Connect Failed");
+    }
+    else if (error == OTA_RECEIVE_ERROR) {
+      LOG.println("Receive Failed");
+    }
+    else if (error == OTA_END_ERROR) {
+      LOG.println("End Failed");
+    }
+    delay(1000);
+    ESP.restart();
+  });
+
+  LOG.setPort(TELNET_LOG_PORT);
+  LOG.setWelcomeMsg("Serial Monitor debug log\n\n");
+  LOG.setDebugOutput(false);
+  telnet.onInput(telnetCommand);
+  telnet.setReplay(&history, 0, &lineClock); // new clients start with the recent lines, e.g. the crash
+  telnet.begin("Serial Logger\r\n\r\n");
+  telnet2.onInput(telnetCommand);
+  telnet2.setReplay(&history, 1, &lineClock);
+  telnet2.begin("Serial Logger channel 2\r\n\r\n");
+  rawBridge.onInput(rawToTarget);
+  rawBridge2.onInput(rawToTarget2);
+  if (RAW_REPLAY) {
+    rawBridge.setReplay(&history, 0, nullptr);
+    rawBridge2.setReplay(&history, 1, nullptr);
   }
+  rawBridge.begin();
+  rawBridge2.begin();
+  return true;
 }
 
+void loop(void) {
+  int64_t passStart = esp_timer_get_time();
+  if (networkStarted) {
+    wifi.handle();
+    networkStatus();
+
+    mqtt.handle(); // never blocks longer than one bounded connect attempt
+    reportMqtt();
+    mqttOut.handle();
+    sdLog.handle();
+    lineClock.handle();
+    if (otaStarted) ArduinoOTA.handle();
+  }
+  LOG.handle();
+  if (networkStarted && wifi.online()) {
+    for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+      channel[ch].telnet->handle();
+      channel[ch].raw->handle();
+    }
+  }
+
+  spiBus.lock(); // display pass, the sd writer runs between two of them
+  applyRemoteConfig();
+  handleTouch();
+  handlePanel();
+
+  // consume from the ingest rings - the uarts themselves are drained by the ingest tasks on core 0.
+  // every channel gets its own budget, a busy one cannot hold back the other
+  bool frozen = menuOpen || displayPaused() || viewingHistory;
+  for (uint8_t ch = 0; ch < CHANNELS; ch++) drainChannel(ch, frozen);
+
+  if (tft.getRotation() == 1) refreshRows(false);
+  updateStats();
+  lineOut.flush();
+  spiBus.unlock();
+
+  reportOverruns();
+  pollAutoBaud();
+  relayoutStep();
+  publishStats();
+  stats.loopTime(esp_timer_get_time() - passStart);
+
+  static bool servicesTried = false;
+  if (!servicesTried) { // the rings have been drained once, the slow part of the boot can follow
+    servicesTried = true;
+    networkStarted = startServices();
+  }
+}
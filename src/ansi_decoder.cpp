@@ -0,0 +1,174 @@
+/**
+ * @file ansi_decoder.cpp
+ *
+ * @brief escape sequence state machine, see ansi_decoder.h
+ */
+
+#include "ansi_decoder.h"
+
+enum State : uint8_t { S_GROUND, S_ESC, S_ESC_INTER, S_CSI, S_CSI_IGNORE, S_OSC, STATES };
+
+enum ByteClass : uint8_t {
+  K_CTRL,   // c0 controls except the ones below
+  K_BEL,    // ends an OSC string
+  K_ESC,
+  K_CAN,    // CAN, SUB abort a sequence
+  K_DIGIT,
+  K_SEMI,   // parameter separators ; and :
+  K_INTER,  // intermediates 0x20..0x2f
+  K_PRIV,   // private parameter markers < = > ?
+  K_CSI,    // [
+  K_OSC,    // ]
+  K_FINAL,  // the rest of 0x40..0x7e
+  K_HIGH,   // DEL and 8 bit bytes
+  CLASSES
+};
+
+enum Step : uint8_t { A_NONE, A_PRINT, A_EXEC, A_START, A_DIGIT, A_SEP, A_DISPATCH, A_ESC_FINAL };
+
+#define T(next, action) (uint8_t)((next) | (action) << 4)
+
+// next state in the low nibble, step in the high nibble
+static const uint8_t transition[STATES][CLASSES] = {
+  // K_CTRL             K_BEL                 K_ESC              K_CAN               K_DIGIT
+  // K_SEMI             K_INTER               K_PRIV             K_CSI               K_OSC
+  // K_FINAL            K_HIGH
+  { // S_GROUND
+    T(S_GROUND, A_EXEC), T(S_GROUND, A_EXEC), T(S_ESC, A_NONE), T(S_GROUND, A_EXEC), T(S_GROUND, A_PRINT),
+    T(S_GROUND, A_PRINT), T(S_GROUND, A_PRINT), T(S_GROUND, A_PRINT), T(S_GROUND, A_PRINT), T(S_GROUND, A_PRINT),
+    T(S_GROUND, A_PRINT), T(S_GROUND, A_PRINT) },
+  { // S_ESC
+    T(S_ESC, A_EXEC), T(S_ESC, A_EXEC), T(S_ESC, A_NONE), T(S_GROUND, A_NONE), T(S_GROUND, A_NONE),
+    T(S_GROUND, A_NONE), T(S_ESC_INTER, A_NONE), T(S_GROUND, A_NONE), T(S_CSI, A_START), T(S_OSC, A_NONE),
+    T(S_GROUND, A_ESC_FINAL), T(S_GROUND, A_NONE) },
+  { // S_ESC_INTER, e.g. ESC ( B
+    T(S_ESC_INTER, A_EXEC), T(S_ESC_INTER, A_EXEC), T(S_ESC, A_NONE), T(S_GROUND, A_NONE), T(S_GROUND, A_NONE),
+    T(S_GROUND, A_NONE), T(S_ESC_INTER, A_NONE), T(S_GROUND, A_NONE), T(S_GROUND, A_NONE), T(S_GROUND, A_NONE),
+    T(S_GROUND, A_NONE), T(S_GROUND, A_NONE) },
+  { // S_CSI - [ and ] are final bytes here
+    T(S_CSI, A_EXEC), T(S_CSI, A_EXEC), T(S_ESC, A_NONE), T(S_GROUND, A_NONE), T(S_CSI, A_DIGIT),
+    T(S_CSI, A_SEP), T(S_CSI_IGNORE, A_NONE), T(S_CSI_IGNORE, A_NONE), T(S_GROUND, A_DISPATCH),
+    T(S_GROUND, A_DISPATCH), T(S_GROUND, A_DISPATCH), T(S_GROUND, A_NONE) },
+  { // S_CSI_IGNORE: private modes and sequences with intermediates, e.g. ESC[?25l
+    T(S_CSI_IGNORE, A_EXEC), T(S_CSI_IGNORE, A_EXEC), T(S_ESC, A_NONE), T(S_GROUND, A_NONE),
+    T(S_CSI_IGNORE, A_NONE), T(S_CSI_IGNORE, A_NONE), T(S_CSI_IGNORE, A_NONE), T(S_CSI_IGNORE, A_NONE),
+    T(S_GROUND, A_NONE), T(S_GROUND, A_NONE), T(S_GROUND, A_NONE), T(S_GROUND, A_NONE) },
+  { // S_OSC: string up to BEL or ESC backslash
+    T(S_OSC, A_NONE), T(S_GROUND, A_NONE), T(S_ESC, A_NONE), T(S_GROUND, A_NONE), T(S_OSC, A_NONE),
+    T(S_OSC, A_NONE), T(S_OSC, A_NONE), T(S_OSC, A_NONE), T(S_OSC, A_NONE), T(S_OSC, A_NONE),
+    T(S_OSC, A_NONE), T(S_OSC, A_NONE) },
+};
+
+#undef T
+
+// xterm like palette, black is lifted to dark grey so it stays readable on the black screen
+static const uint16_t palette[ANSI_COLOURS - 1] = {
+  0x4208, 0xC800, 0x0660, 0xCE60, 0x421F, 0xC819, 0x0679, 0xE73C,
+  0x7BEF, 0xF800, 0x07E0, 0xFFE0, 0x5AFF, 0xF81F, 0x07FF, 0xFFFF,
+};
+
+static ByteClass classify(uint8_t c) {
+  if (c >= 0x7f) return K_HIGH;
+  if (c >= 0x40) return c == '[' ? K_CSI : c == ']' ? K_OSC : K_FINAL;
+  if (c >= 0x30) return c <= '9' ? K_DIGIT : c <= ';' ? K_SEMI : K_PRIV;
+  if (c >= 0x20) return K_INTER;
+  if (c == 0x1b) return K_ESC;
+  if (c == 0x07) return K_BEL;
+  if (c == 0x18 || c == 0x1a) return K_CAN;
+  return K_CTRL;
+}
+
+AnsiDecoder::AnsiDecoder() {
+  reset();
+}
+
+void AnsiDecoder::reset() {
+  state = S_GROUND;
+  fg = 0;
+  bold = false;
+  count = 0;
+  param[0] = 0;
+}
+
+uint16_t AnsiDecoder::rgb565(uint8_t colour, uint16_t base) {
+  return colour >= 1 && colour < ANSI_COLOURS ? palette[colour - 1] : base;
+}
+
+size_t AnsiDecoder::sgr(uint8_t colour, char *out) {
+  uint8_t code = colour >= 1 && colour <= 8 ? 29 + colour : colour > 8 && colour < ANSI_COLOURS ? 81 + colour : 0;
+  size_t n = 0;
+
+  out[n++] = 0x1b;
+  out[n++] = '[';
+  if (code >= 10) out[n++] = '0' + code / 10;
+  out[n++] = '0' + code % 10;
+  out[n++] = 'm';
+  return n;
+}
+
+AnsiDecoder::Action AnsiDecoder::advance(uint8_t c) {
+  uint8_t t = transition[state][classify(c)];
+  state = t & 0x0f;
+
+  switch (t >> 4) {
+    case A_PRINT: return ANSI_PRINT;
+    case A_EXEC: return ANSI_EXECUTE;
+    case A_START:
+      count = 0;
+      param[0] = 0;
+      return ANSI_NONE;
+    case A_DIGIT:
+      if (param[count] < 10000) param[count] = param[count] * 10 + (c - '0');
+      return ANSI_NONE;
+    case A_SEP:
+      if (count < ANSI_MAX_PARAMS - 1) param[++count] = 0; // surplus parameters are dropped
+      return ANSI_NONE;
+    case A_DISPATCH: return dispatch(c);
+    case A_ESC_FINAL:
+      if (c != 'c') return ANSI_NONE; // ESC c: full reset
+      reset();
+      return ANSI_COLOUR;
+    default: return ANSI_NONE;
+  }
+}
+
+// complete CSI sequence - only the ones that change what a line looks like matter here, the cursor always
+// sits at the end of the line being assembled
+AnsiDecoder::Action AnsiDecoder::dispatch(uint8_t final) {
+  switch (final) {
+    case 'm':
+      selectGraphics();
+      return ANSI_COLOUR;
+    case 'K':
+      return param[0] == 1 || param[0] == 2 ? ANSI_CLEAR_LINE : ANSI_NONE; // erase right of the cursor: nothing
+    case 'J':
+      return param[0] == 2 || param[0] == 3 ? ANSI_CLEAR_SCREEN : ANSI_NONE;
+    default:
+      return ANSI_NONE;
+  }
+}
+
+void AnsiDecoder::selectGraphics() {
+  for (uint8_t i = 0; i <= count; i++) {
+    uint16_t p = param[i];
+    if (p == 0) {
+      fg = 0;
+      bold = false;
+    } else if (p == 1) {
+      bold = true;
+    } else if (p == 22) {
+      bold = false;
+    } else if (p >= 30 && p <= 37) {
+      fg = p - 30 + 1;
+    } else if (p == 39) {
+      fg = 0;
+    } else if (p >= 90 && p <= 97) {
+      fg = p - 90 + 9;
+    } else if (p == 38 || p == 48) {
+      // extended colours: 5;n picks from 256, the first 16 map onto the palette - 2;r;g;b is skipped
+      bool mode256 = i + 2 <= count && param[i + 1] == 5;
+      if (p == 38 && mode256 && param[i + 2] < 16) fg = param[i + 2] + 1;
+      i += mode256 ? 2 : i + 1 <= count && param[i + 1] == 2 ? 4 : 0;
+    }
+  }
+}
@@ -0,0 +1,68 @@
+/**
+ * @file ansi_decoder.h
+ *
+ * @brief incremental decoder for the ANSI / VT100 escape sequences in the serial stream. A table driven state
+ * machine (states x byte classes) consumes one byte per step and keeps its state between chunks, so a sequence
+ * split across two uart reads is still recognised. No allocation, parameters live in a small fixed array.
+ * SGR colours are tracked as an index into a 16 colour palette, erase line and erase display are reported to
+ * the caller, every other sequence (cursor movement, private modes, OSC strings ...) is swallowed.
+ * Pure c++ without arduino dependencies.
+ */
+
+#ifndef ANSI_DECODER_H
+#define ANSI_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ANSI_MAX_PARAMS 8
+#define ANSI_COLOURS 17 // 0 = default colour of the line, 1..8 = SGR 30..37, 9..16 = SGR 90..97 (or bold 30..37)
+
+// colour changes are kept inside the line text as one byte LINE_COLOUR_MARKER + colour index. the markers are
+// below the printable range, so they never collide with captured text
+#define LINE_COLOUR_MARKER 0x01
+
+class AnsiDecoder {
+public:
+  enum Action : uint8_t {
+    ANSI_NONE,         // byte belongs to a sequence
+    ANSI_PRINT,        // printable byte outside of a sequence
+    ANSI_EXECUTE,      // control character, e.g. '\r', also when it shows up inside a sequence
+    ANSI_COLOUR,       // colour() changed
+    ANSI_CLEAR_LINE,   // erase the line up to the cursor (ESC[1K, ESC[2K)
+    ANSI_CLEAR_SCREEN, // erase display (ESC[2J, ESC[3J)
+  };
+
+  AnsiDecoder();
+
+  // feed one byte
+  Action step(uint8_t c) {
+    if (state == 0 && c >= 0x20 && c < 0x7f) return ANSI_PRINT; // plain text skips the table
+    return advance(c);
+  }
+
+  // current foreground colour, see ANSI_COLOURS
+  uint8_t colour() const { return bold && fg >= 1 && fg <= 8 ? fg + 8 : fg; }
+
+  // back to ground state and default colour
+  void reset();
+
+  // rgb565 value of a colour index, base for the default colour
+  static uint16_t rgb565(uint8_t colour, uint16_t base);
+
+  // SGR sequence which selects a colour index again (ESC[0m for the default), returns its length - at most 5
+  static size_t sgr(uint8_t colour, char *out);
+
+private:
+  Action advance(uint8_t c);
+  Action dispatch(uint8_t final);
+  void selectGraphics();
+
+  uint8_t state;
+  uint8_t fg;
+  bool bold;
+  uint8_t count; // index of the parameter being collected
+  uint16_t param[ANSI_MAX_PARAMS];
+};
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * @file block_codec.cpp
+ *
+ * @brief LZ4 block packing, see block_codec.h
+ */
+
+#include <string.h>
+#include "block_codec.h"
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5 // the format ends every block with literals ...
+#define MATCH_LIMIT 12  // ... and no match starts in its last 12 bytes
+#define NO_POSITION 0xffff
+
+static inline uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t hash(uint32_t v) {
+  return (v * 2654435761U) >> (32 - CODEC_HASH_BITS);
+}
+
+// length continuation bytes of a 4 bit token field which is saturated at 15
+static inline uint8_t *putLength(uint8_t *d, size_t n) {
+  for (; n >= 255; n -= 255) *d++ = 255;
+  *d++ = (uint8_t)n;
+  return d;
+}
+
+size_t BlockCodec::pack(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+  if (len > CODEC_MAX_BLOCK) return 0;
+
+  uint8_t *d = dst;
+  uint8_t *dEnd = dst + cap;
+  size_t anchor = 0;
+  size_t ip = 0;
+
+  memset(table, 0xff, sizeof(table));
+  if (len > MATCH_LIMIT) {
+    size_t limit = len - MATCH_LIMIT;
+    size_t matchEnd = len - LAST_LITERALS;
+
+    while (ip < limit) {
+      uint32_t seq = read32(src + ip);
+      uint32_t h = hash(seq);
+      size_t ref = table[h];
+      table[h] = (uint16_t)ip;
+      if (ref == NO_POSITION || read32(src + ref) != seq) {
+        ip++;
+        continue;
+      }
+
+      size_t m = MIN_MATCH;
+      while (ip + m < matchEnd && src[ref + m] == src[ip + m]) m++;
+
+      // token, literal length, literals, offset, match length - worst case checked up front
+      size_t lit = ip - anchor;
+      if ((size_t)(dEnd - d) < 1 + lit / 255 + 1 + lit + 2 + (m - MIN_MATCH) / 255 + 1) return 0;
+      uint8_t *token = d++;
+      *token = (uint8_t)((lit < 15 ? lit : 15) << 4);
+      if (lit >= 15) d = putLength(d, lit - 15);
+      memcpy(d, src + anchor, lit);
+      d += lit;
+      uint16_t offset = (uint16_t)(ip - ref);
+      *d++ = offset & 0xff;
+      *d++ = offset >> 8;
+      size_t ml = m - MIN_MATCH;
+      *token |= ml < 15 ? ml : 15;
+      if (ml >= 15) d = putLength(d, ml - 15);
+
+      ip += m;
+      anchor = ip;
+    }
+  }
+
+  size_t lit = len - anchor;
+  if ((size_t)(dEnd - d) < 1 + lit / 255 + 1 + lit) return 0;
+  *d++ = (uint8_t)((lit < 15 ? lit : 15) << 4);
+  if (lit >= 15) d = putLength(d, lit - 15);
+  memcpy(d, src + anchor, lit);
+  d += lit;
+  return d - dst;
+}
+
+size_t BlockCodec::unpack(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+  const uint8_t *s = src;
+  const uint8_t *sEnd = src + len;
+  size_t n = 0;
+
+  while (s < sEnd) {
+    uint8_t token = *s++;
+
+    size_t lit = token >> 4;
+    if (lit == 15) {
+      uint8_t b;
+      do {
+        if (s == sEnd) return 0;
+        b = *s++;
+        lit += b;
+      } while (b == 255);
+    }
+    if ((size_t)(sEnd - s) < lit || cap - n < lit) return 0;
+    memcpy(dst + n, s, lit);
+    s += lit;
+    n += lit;
+    if (s == sEnd) return n; // the last sequence has no match
+
+    if (sEnd - s < 2) return 0;
+    size_t offset = s[0] | (s[1] << 8);
+    s += 2;
+    if (offset == 0 || offset > n) return 0;
+
+    size_t m = (token & 15) + MIN_MATCH;
+    if ((token & 15) == 15) {
+      uint8_t b;
+      do {
+        if (s == sEnd) return 0;
+        b = *s++;
+        m += b;
+      } while (b == 255);
+    }
+    if (cap - n < m) return 0;
+    // byte by byte, a match may overlap the bytes it produces
+    for (size_t i = 0; i < m; i++, n++) dst[n] = dst[n - offset];
+  }
+  return n;
+}
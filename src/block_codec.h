@@ -0,0 +1,32 @@
+/**
+ * @file block_codec.h
+ *
+ * @brief LZ4 block format compressor and decoder for the history and sd log blocks. Log lines repeat a lot
+ * (prefixes, stamps, whole phrases), so a greedy match finder with a small hash table over the block already
+ * gets several times smaller blocks. Every block is packed on its own and can be decoded without the ones before
+ * it. The output is plain LZ4 block data, any LZ4 block decoder reads it when given the raw size.
+ * Pure c++ without arduino dependencies.
+ */
+
+#ifndef BLOCK_CODEC_H
+#define BLOCK_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CODEC_HASH_BITS 11     // 4 kb match table
+#define CODEC_MAX_BLOCK 65535  // match positions are 16 bit
+
+class BlockCodec {
+public:
+  // pack src[0..len) into dst, returns the packed size or 0 if it does not fit into cap - store the block raw then
+  size_t pack(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+  // unpack a block into dst, returns the raw size or 0 if the data is corrupt or does not fit into cap
+  static size_t unpack(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+private:
+  uint16_t table[1 << CODEC_HASH_BITS]; // last position of each hashed 4 byte sequence
+};
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * @file glyph_atlas.cpp
+ *
+ * @brief pre-rendered free font glyphs, see glyph_atlas.h
+ */
+
+#include <esp_heap_caps.h>
+#include "glyph_atlas.h"
+
+GlyphAtlas::GlyphAtlas() : cells(nullptr), built(nullptr), cellWidth(0), cellHeight(0) {}
+
+bool GlyphAtlas::build(TFT_eSPI *tft, const GFXfont *font, const uint8_t *advances, int16_t height,
+                       int16_t baseline) {
+  release();
+
+  int16_t width = 0;
+  for (uint8_t i = 0; i < LINE_GLYPHS; i++) {
+    if (advances[i] > width) width = advances[i];
+  }
+  if (!font || width == 0 || height <= 0) return false;
+
+  size_t cell = (size_t)width * height;
+  size_t bytes = cell * LINE_GLYPHS * sizeof(uint16_t);
+  cells = psramFound() ? (uint16_t *)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM) : nullptr;
+  // 96 cells of a large font are tens of kb, the scratch cell below comes on top for a moment
+  size_t need = bytes + cell * sizeof(uint16_t) + ATLAS_HEAP_RESERVE;
+  if (!cells && heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) >= need) {
+    cells = (uint16_t *)heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  }
+  if (!cells) return false;
+
+  // one scratch cell, drawChar does the decoding once per glyph here instead of once per glyph shown
+  TFT_eSprite scratch(tft);
+  scratch.setColorDepth(16);
+  if (!scratch.createSprite(width, height)) {
+    release();
+    return false;
+  }
+  scratch.setFreeFont(font);
+  scratch.setTextColor(TFT_WHITE);
+  const uint16_t *pixels = (const uint16_t *)scratch.getPointer();
+  for (uint8_t i = 0; i < LINE_GLYPHS; i++) {
+    scratch.fillSprite(TFT_BLACK);
+    scratch.drawChar(LINE_FIRST_CHAR + i, 0, baseline);
+    memcpy(cells + i * cell, pixels, cell * sizeof(uint16_t));
+  }
+  scratch.deleteSprite();
+
+  built = font;
+  cellWidth = width;
+  cellHeight = height;
+  return true;
+}
+
+void GlyphAtlas::release() {
+  free(cells); // heap_caps allocations, psram included, go back through free()
+  cells = nullptr;
+  built = nullptr;
+  cellWidth = 0;
+  cellHeight = 0;
+}
+
+void GlyphAtlas::blit(uint16_t *dst, int16_t dstWidth, int16_t x, uint8_t c, uint16_t colour) const {
+  if (!cells || x < 0 || x >= dstWidth || c < LINE_FIRST_CHAR || c >= LINE_FIRST_CHAR + LINE_GLYPHS) return;
+
+  int16_t cols = dstWidth - x < cellWidth ? dstWidth - x : cellWidth;
+  const uint16_t *src = cells + (size_t)(c - LINE_FIRST_CHAR) * cellWidth * cellHeight;
+  dst += x;
+
+  if (colour == TFT_WHITE) { // the cells are white already
+    for (int16_t y = 0; y < cellHeight; y++, src += cellWidth, dst += dstWidth) {
+      memcpy(dst, src, cols * sizeof(uint16_t));
+    }
+    return;
+  }
+
+  uint16_t mask = (colour >> 8) | (colour << 8); // sprite buffers hold byte swapped pixels
+  for (int16_t y = 0; y < cellHeight; y++, src += cellWidth, dst += dstWidth) {
+    for (int16_t i = 0; i < cols; i++) dst[i] = src[i] & mask;
+  }
+}
@@ -0,0 +1,50 @@
+/**
+ * @file glyph_atlas.h
+ *
+ * @brief the printable glyphs of one GFX free font, rendered once into rgb565 cells of advance x line height
+ * pixels. Drawing a glyph is then a row by row copy into the line sprite instead of decoding the bitmap from
+ * flash: glyph pixels are stored as 0xffff on black, so a plain copy draws white and an AND with the text colour
+ * any other. Only fits monospaced fonts whose glyphs stay inside their advance, like the FreeMono line fonts.
+ * The cells live in psram when the board has it. In internal ram they are only built while the largest free
+ * block stays ATLAS_HEAP_RESERVE above them - wifi, tcp and mqtt need it more than the renderer, which draws with
+ * drawChar without the atlas. Built on first use, freed when the font goes out of use.
+ */
+
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include "line_assembler.h"
+
+#define ATLAS_HEAP_RESERVE (48 * 1024) // internal heap left to the network stack when the cells are not in psram
+
+class GlyphAtlas {
+public:
+  GlyphAtlas();
+  ~GlyphAtlas() { release(); }
+
+  // render the glyphs of font into cells as wide as its widest advance, false if out of memory
+  bool build(TFT_eSPI *tft, const GFXfont *font, const uint8_t *advances, int16_t height, int16_t baseline);
+
+  // the atlas holds font in cells of this height
+  bool matches(const GFXfont *font, int16_t height) const {
+    return cells && font == built && height == cellHeight;
+  }
+
+  bool ready() const { return cells != nullptr; }
+
+  void release();
+
+  // copy the cell of glyph c to column x of a 16 bit sprite buffer of dstWidth x cell height pixels, clipped at
+  // its right edge. colour is a plain rgb565 value, the swap to sprite byte order happens here
+  void blit(uint16_t *dst, int16_t dstWidth, int16_t x, uint8_t c, uint16_t colour) const;
+
+private:
+  uint16_t *cells;
+  const GFXfont *built;
+  int16_t cellWidth;
+  int16_t cellHeight;
+};
+
+#endif
@@ -0,0 +1,190 @@
+/**
+ * @file history.cpp
+ *
+ * @brief scrollback arena of packed blocks, see history.h
+ */
+
+#include <string.h>
+#include "history.h"
+
+#define NO_BLOCK 0xffffffffU
+
+LineHistory::LineHistory()
+  : arena(nullptr), bytes(0), index(nullptr), mask(0), firstBlock(0), nextBlock(0), head(0), wr(0), open(nullptr),
+    openLen(0), openSeq(0), openLines(0), victim(0), packedIn(0), packedOut(0) {
+  for (uint8_t i = 0; i < 2; i++) {
+    cache[i].data = nullptr;
+    cache[i].block = NO_BLOCK;
+    cache[i].lines = 0;
+  }
+}
+
+bool LineHistory::begin(uint8_t *storage, size_t arenaBytes, Block *blockIndex, uint32_t maxBlocks) {
+  if (storage == nullptr || blockIndex == nullptr || maxBlocks == 0 || (maxBlocks & (maxBlocks - 1)) != 0) return false;
+  // open block and two decode buffers in front, room for at least one packed block behind them
+  if (arenaBytes < 4 * HISTORY_BLOCK_BYTES + blockHeader) return false;
+
+  open = storage;
+  for (uint8_t i = 0; i < 2; i++) {
+    cache[i].data = storage + (i + 1) * HISTORY_BLOCK_BYTES;
+    cache[i].block = NO_BLOCK;
+  }
+  arena = storage + 3 * HISTORY_BLOCK_BYTES;
+  bytes = arenaBytes - 3 * HISTORY_BLOCK_BYTES;
+  index = blockIndex;
+  mask = maxBlocks - 1;
+  firstBlock = nextBlock = 0;
+  head = 0;
+  wr = 0;
+  openLen = 0;
+  openSeq = 0;
+  openLines = 0;
+  packedIn = packedOut = 0;
+  return true;
+}
+
+uint32_t LineHistory::first() const {
+  return firstBlock != nextBlock ? index[firstBlock & mask].seq : openSeq;
+}
+
+uint32_t LineHistory::append(const char *text, size_t len, int64_t stamp, uint8_t channel) {
+  if (arena == nullptr) return head;
+
+  if (len > HISTORY_BLOCK_BYTES - recordHeader) len = HISTORY_BLOCK_BYTES - recordHeader;
+  size_t need = recordHeader + len;
+  if (openLen + need > HISTORY_BLOCK_BYTES || openLines == HISTORY_BLOCK_LINES) seal();
+
+  uint8_t *r = open + openLen;
+  header_t h = (header_t)len;
+  memcpy(r, &stamp, sizeof(stamp)); // records are not aligned, always copy
+  r[sizeof(stamp)] = channel;
+  memcpy(r + sizeof(stamp) + 1, &h, sizeof(h));
+  memcpy(r + recordHeader, text, len);
+
+  openOffset[openLines++] = openLen;
+  openLen += need;
+  return head++;
+}
+
+// pack the open block into the arena and start the next one with line head
+void LineHistory::seal() {
+  if (openLines == 0) return;
+
+  // the decode buffer next in line for reuse takes the packed data, a block which does not shrink stays raw
+  Decoded &scratch = cache[victim];
+  scratch.block = NO_BLOCK;
+  size_t packed = codec.pack(open, openLen, scratch.data, openLen - 1);
+  const uint8_t *data = packed ? scratch.data : open;
+  if (!packed) packed = openLen;
+  size_t need = blockHeader + packed;
+
+  if (nextBlock - firstBlock > mask) evictOldest(); // index full
+  if (firstBlock == nextBlock) wr = 0;
+
+  // blocks stay contiguous: drop what is stored behind the write position, skip the unused tail of the arena
+  // and start over at the front
+  if (wr + need > bytes) {
+    while (firstBlock != nextBlock && index[firstBlock & mask].offset >= wr) evictOldest();
+    wr = 0;
+  }
+
+  // evict the oldest blocks until the region [wr, wr + need) is free
+  while (firstBlock != nextBlock) {
+    uint32_t o = index[firstBlock & mask].offset;
+    if (o < wr || o >= wr + need) break;
+    evictOldest();
+  }
+
+  uint16_t h[3] = {(uint16_t)openLen, (uint16_t)packed, openLines};
+  memcpy(arena + wr, h, sizeof(h));
+  memcpy(arena + wr + blockHeader, data, packed);
+  index[nextBlock & mask].seq = openSeq;
+  index[nextBlock & mask].offset = wr;
+  nextBlock++;
+  wr += need;
+  packedIn += openLen;
+  packedOut += need;
+
+  openSeq = head;
+  openLen = 0;
+  openLines = 0;
+}
+
+bool LineHistory::get(uint32_t seq, const char **text, size_t *len, int64_t *stamp, uint8_t *channel) const {
+  if (seq - first() >= size()) return false;
+
+  if (seq - openSeq < openLines) {
+    readRecord(open + openOffset[seq - openSeq], text, len, stamp, channel);
+    return true;
+  }
+
+  uint32_t b = findBlock(seq);
+  const Decoded *d = decode(b);
+  uint32_t i = seq - index[b & mask].seq;
+  if (d == nullptr || i >= d->lines) return false;
+  readRecord(d->data + d->offset[i], text, len, stamp, channel);
+  return true;
+}
+
+// last stored block starting at or before seq, which has to be stored
+uint32_t LineHistory::findBlock(uint32_t seq) const {
+  uint32_t base = first();
+  uint32_t lo = firstBlock;
+  uint32_t hi = nextBlock;
+
+  while (hi - lo > 1) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (index[mid & mask].seq - base <= seq - base) lo = mid;
+    else hi = mid;
+  }
+  return lo;
+}
+
+const LineHistory::Decoded *LineHistory::decode(uint32_t block) const {
+  for (uint8_t i = 0; i < 2; i++) {
+    if (cache[i].block == block) {
+      victim = i ^ 1;
+      return &cache[i];
+    }
+  }
+
+  Decoded &d = cache[victim];
+  const uint8_t *p = arena + index[block & mask].offset;
+  uint16_t h[3];
+  memcpy(h, p, sizeof(h));
+  size_t raw = h[0];
+  if (h[1] == raw) memcpy(d.data, p + blockHeader, raw);
+  else if (BlockCodec::unpack(p + blockHeader, h[1], d.data, HISTORY_BLOCK_BYTES) != raw) return nullptr;
+
+  d.lines = scan(d.data, raw, d.offset);
+  if (d.lines != h[2]) return nullptr;
+  d.block = block;
+  victim ^= 1;
+  return &d;
+}
+
+uint16_t LineHistory::scan(const uint8_t *data, size_t len, uint16_t *offset) {
+  uint16_t n = 0;
+  size_t o = 0;
+
+  while (o + recordHeader <= len && n < HISTORY_BLOCK_LINES) {
+    header_t h;
+    memcpy(&h, data + o + sizeof(int64_t) + 1, sizeof(h));
+    offset[n++] = o;
+    o += recordHeader + h;
+  }
+  return o == len ? n : 0;
+}
+
+void LineHistory::readRecord(const uint8_t *r, const char **text, size_t *len, int64_t *stamp, uint8_t *channel) {
+  header_t h;
+  memcpy(&h, r + sizeof(int64_t) + 1, sizeof(h));
+  if (stamp) memcpy(stamp, r, sizeof(int64_t));
+  if (channel) *channel = r[sizeof(int64_t)];
+  *text = (const char *)r + recordHeader;
+  *len = h;
+}
+
+void LineHistory::evictOldest() {
+  if (firstBlock != nextBlock) firstBlock++;
+}
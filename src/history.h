@@ -0,0 +1,108 @@
+/**
+ * @file history.h
+ *
+ * @brief scrollback store for the last received lines. Lines are collected with their receive stamp, channel
+ * and length in front into an open block of HISTORY_BLOCK_BYTES; a full block is packed (see block_codec.h)
+ * into one contiguous arena, and a ring of block index entries (first sequence number, arena offset) finds the
+ * block of any line with a binary search - no per line String, heap allocation or index entry. Every block
+ * decodes on its own, the last two decoded are kept, so paging through the scrollback unpacks each block once.
+ * Blocks are never split at the arena end. The oldest blocks are evicted when the arena or the index runs full,
+ * memory use is fixed by the sizes handed to begin() - the open block and the decode buffers are taken from the
+ * arena. Pure c++ without arduino dependencies.
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "block_codec.h"
+
+// arena and block index size, psram sizes are used automatically on boards which have it
+#ifndef HISTORY_RAM_BYTES
+#define HISTORY_RAM_BYTES (48 * 1024)
+#endif
+#ifndef HISTORY_RAM_BLOCKS
+#define HISTORY_RAM_BLOCKS 128 // power of two
+#endif
+#ifndef HISTORY_PSRAM_BYTES
+#define HISTORY_PSRAM_BYTES (1024 * 1024)
+#endif
+#ifndef HISTORY_PSRAM_BLOCKS
+#define HISTORY_PSRAM_BLOCKS 4096 // power of two
+#endif
+#define HISTORY_BLOCK_BYTES 4096 // raw bytes of one block, the unit of packing and decoding
+#define HISTORY_BLOCK_LINES 372  // records of at least 11 bytes
+
+class LineHistory {
+public:
+  struct Block {
+    uint32_t seq;    // first line
+    uint32_t offset; // arena offset of the packed block
+  };
+
+  LineHistory();
+
+  // arena and index are owned by the caller, maxBlocks must be a power of two
+  bool begin(uint8_t *arena, size_t arenaBytes, Block *index, uint32_t maxBlocks);
+
+  // store a line with its receive time (esp_timer microseconds) and capture channel, returns its sequence number
+  uint32_t append(const char *text, size_t len, int64_t stamp = 0, uint8_t channel = 0);
+
+  // stored lines are [first(), end())
+  uint32_t first() const;
+  uint32_t end() const { return head; }
+  uint32_t size() const { return head - first(); }
+
+  // text of line seq, false once evicted. it points into the open block or a decode buffer and stays valid until
+  // the next get() or append()
+  bool get(uint32_t seq, const char **text, size_t *len, int64_t *stamp = nullptr, uint8_t *channel = nullptr) const;
+
+  size_t arenaBytes() const { return bytes; }
+  uint64_t rawBytes() const { return packedIn; }    // line records packed so far ...
+  uint64_t packedBytes() const { return packedOut; } // ... and what they took in the arena
+
+private:
+  typedef uint16_t header_t; // text length in front of every record, after the stamp and channel
+  static const size_t recordHeader = sizeof(int64_t) + 1 + sizeof(header_t);
+  static const size_t blockHeader = 3 * sizeof(uint16_t); // raw size, packed size (== raw: stored), lines
+
+  // lines of one block unpacked, with the offset of every record
+  struct Decoded {
+    uint8_t *data;
+    uint32_t block; // block number, ~0 = none
+    uint16_t lines;
+    uint16_t offset[HISTORY_BLOCK_LINES];
+  };
+
+  void seal();
+  void evictOldest();
+  uint32_t findBlock(uint32_t seq) const;
+  const Decoded *decode(uint32_t block) const;
+  static uint16_t scan(const uint8_t *data, size_t len, uint16_t *offset);
+  static void readRecord(const uint8_t *r, const char **text, size_t *len, int64_t *stamp, uint8_t *channel);
+
+  uint8_t *arena;
+  size_t bytes;   // packed blocks, behind the buffers
+  Block *index;
+  uint32_t mask;
+  uint32_t firstBlock; // blocks stored are [firstBlock, nextBlock)
+  uint32_t nextBlock;
+  uint32_t head;  // sequence number of the next line
+  size_t wr;      // arena write offset
+
+  // open block
+  uint8_t *open;
+  size_t openLen;
+  uint32_t openSeq; // its first line
+  uint16_t openLines;
+  uint16_t openOffset[HISTORY_BLOCK_LINES];
+
+  mutable Decoded cache[2];
+  mutable uint8_t victim;
+  BlockCodec codec;
+  uint64_t packedIn;
+  uint64_t packedOut;
+};
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * @file line_assembler.cpp
+ *
+ * @brief line assembly, see line_assembler.h
+ */
+
+#include "line_assembler.h"
+#include "text_layout.h"
+
+LineAssembler::LineAssembler()
+  : len(0), row(0), end(0), px(0), wrapPx(310), done(false), wrap(false), adv(nullptr), ink(0), clear(false),
+    erase(false) {
+  buf[0] = 0;
+}
+
+void LineAssembler::setAdvances(const uint8_t *advances) {
+  adv = advances;
+}
+
+size_t LineAssembler::feed(const uint8_t *data, size_t count) {
+  if (done) return 0;
+
+  for (size_t i = 0; i < count; i++) {
+    uint8_t c = data[i];
+
+    switch (ansi.step(c)) {
+      case AnsiDecoder::ANSI_PRINT:
+        break;
+      case AnsiDecoder::ANSI_EXECUTE:
+        if (c == '\r') {
+          end = len;
+          done = true;
+          wrap = false;
+          return i + 1;
+        }
+        continue;
+      case AnsiDecoder::ANSI_CLEAR_LINE:
+        len = row;
+        px = 0;
+        ink = layoutColour(buf, len);
+        buf[len] = 0;
+        erase = true;
+        continue;
+      case AnsiDecoder::ANSI_CLEAR_SCREEN:
+        clear = true;
+        continue;
+      default:
+        continue;
+    }
+
+    if (c >= LINE_FIRST_CHAR && c < LINE_FIRST_CHAR + LINE_GLYPHS) {
+      uint8_t colour = ansi.colour();
+      size_t need = colour != ink ? 2 : 1;
+
+      // a glyph which is not taken is fed again with the next row, which is fine as printable bytes leave the
+      // decoder state alone
+      if (len + need > LINE_MAX_TEXT) {
+        end = len;
+        done = true;
+        wrap = false;
+        return i;
+      }
+      // same rule as the old per character loop: wrap before the glyph once we are past the margin. the row is
+      // broken like layoutRow() does it, a word already collected moves on to the next row
+      if (px > wrapPx || len + need - 1 - row >= LINE_MAX_CHARS - 1) {
+        size_t cut = layoutBreak(buf + row, len - row, c);
+        done = true;
+        wrap = true;
+        if (cut <= (size_t)(len - row)) {
+          end = row + cut;
+          return i;
+        }
+        // the space goes to the end of this row
+      }
+      if (colour != ink) {
+        buf[len++] = LINE_COLOUR_MARKER + colour;
+        ink = colour;
+      }
+      buf[len++] = c;
+      buf[len] = 0;
+      px += adv ? adv[c - LINE_FIRST_CHAR] : 6;
+      if (done) {
+        end = len;
+        return i + 1;
+      }
+    }
+  }
+  return count;
+}
+
+void LineAssembler::next() {
+  if (done && wrap) { // the line goes on, with what was moved over from the last row
+    row = end;
+    px = 0;
+    for (size_t i = row; i < len; i++) {
+      uint8_t c = buf[i];
+      if (c >= LINE_FIRST_CHAR) px += adv ? adv[c - LINE_FIRST_CHAR] : 6;
+    }
+  } else {
+    len = 0;
+    row = 0;
+    px = 0;
+    ink = 0;
+    buf[0] = 0;
+  }
+  end = len;
+  done = false;
+  wrap = false;
+}
+
+size_t stripMarkers(char *dst, const char *text, size_t len) {
+  size_t n = 0;
+  for (size_t i = 0; i < len; i++) {
+    if ((uint8_t)text[i] >= LINE_FIRST_CHAR) dst[n++] = text[i];
+  }
+  return n;
+}
+
+bool LineAssembler::takeErase() {
+  bool was = erase;
+  erase = false;
+  return was;
+}
+
+bool LineAssembler::takeClear() {
+  bool was = clear;
+  clear = false;
+  return was;
+}
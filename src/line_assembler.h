@@ -0,0 +1,79 @@
+/**
+ * @file line_assembler.h
+ *
+ * @brief collects printable bytes of the serial stream into lines and screen rows. A line ends at '\r', a row
+ * when its pixel width passes the wrap width - it is broken after its last space (see text_layout.h), so the
+ * renderer can draw a whole row at once instead of single glyphs and words stay in one piece.
+ * ANSI escape sequences are decoded on the way in: colours end up as marker bytes in the text (see
+ * ansi_decoder.h), erase line drops what was collected of the current row (takeErase() tells the display to
+ * start the row over), erase display is passed on with takeClear().
+ * Pure c++ without arduino dependencies, glyph widths are handed in as a table.
+ */
+
+#ifndef LINE_ASSEMBLER_H
+#define LINE_ASSEMBLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ansi_decoder.h"
+
+#define LINE_MAX_CHARS 160 // one screen row, the wrap width normally ends a row long before
+#define LINE_MAX_TEXT 480  // one received line, a longer one is split into two lines
+#define LINE_FIRST_CHAR 32
+#define LINE_GLYPHS 96     // printable range 32..127 like the original render loop
+
+class LineAssembler {
+public:
+  LineAssembler();
+
+  // pixel advance for each of the LINE_GLYPHS printable characters, nullptr = fixed 6px (glcd font)
+  void setAdvances(const uint8_t *advances);
+  void setWrapWidth(uint16_t px) { wrapPx = px; }
+
+  // consumes bytes until a row is complete (or data runs out) and returns the number of bytes used.
+  // when complete() is true the caller takes the row (and at the end of a line the line) and calls next()
+  // before feeding again.
+  size_t feed(const uint8_t *data, size_t len);
+
+  bool complete() const { return done; }
+  bool wrapped() const { return wrap; } // row ended by width, the line continues in the next row
+
+  // the current row: printable characters and colour markers
+  const char *text() const { return buf + row; }
+  size_t length() const { return (done ? end : len) - row; }
+  uint16_t width() const { return px; }
+
+  // the whole line up to the end of the current row, text() starts at rowStart() in it
+  const char *line() const { return buf; }
+  size_t lineLength() const { return done ? end : len; }
+  size_t rowStart() const { return row; }
+
+  // start the next row - after a wrapped one the line continues, otherwise a new line starts
+  void next();
+
+  // true once after the stream asked to erase the display
+  bool takeClear();
+
+  // true once after the row being collected was erased, text() no longer continues what was shown of it
+  bool takeErase();
+
+private:
+  char buf[LINE_MAX_TEXT + 1];
+  uint16_t len;   // bytes collected, a word moved to the next row is already in
+  uint16_t row;   // start of the current row
+  uint16_t end;   // end of the completed row
+  uint16_t px;    // width of buf[row, len)
+  uint16_t wrapPx;
+  bool done;
+  bool wrap;
+  const uint8_t *adv;
+  AnsiDecoder ansi;
+  uint8_t ink;  // colour of the last glyph in buf, a marker goes in front of the next one when it changes
+  bool clear;
+  bool erase;
+};
+
+// copy a line without its colour markers, for the consumers which want plain text. returns the copied length
+size_t stripMarkers(char *dst, const char *text, size_t len);
+
+#endif
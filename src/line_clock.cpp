@@ -0,0 +1,50 @@
+/**
+ * @file line_clock.cpp
+ *
+ * @brief line stamp time base, see line_clock.h
+ */
+
+#include <sys/time.h>
+#include <time.h>
+#include <esp_timer.h>
+#include "line_clock.h"
+
+#define CLOCK_VALID_AFTER 1600000000 // system time before 2020 means sntp has not synced yet
+
+LineClock lineClock;
+
+LineClock::LineClock() : offset(0), nextCheck(0), enabled(false) {}
+
+void LineClock::begin(const char *ntpServer, const char *tz) {
+  if (ntpServer == nullptr || ntpServer[0] == 0) return;
+  enabled = true;
+  configTzTime(tz, ntpServer); // sntp runs in the background and starts once wifi is up
+}
+
+void LineClock::handle() {
+  if (!enabled || (int32_t)(millis() - nextCheck) < 0) return;
+  nextCheck = millis() + (anchored() ? CLOCK_ANCHOR_MS : 1000);
+
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  if (tv.tv_sec < CLOCK_VALID_AFTER) return;
+  offset = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec - esp_timer_get_time();
+}
+
+size_t LineClock::format(int64_t stamp, char *buf, size_t size, uint8_t digits, int64_t anchor) const {
+  uint32_t frac = digits == 6 ? stamp % 1000000 : (stamp % 1000000) / 1000;
+  int n;
+
+  if (anchor != 0) {
+    int64_t us = stamp + anchor;
+    time_t secs = us / 1000000;
+    struct tm t;
+    localtime_r(&secs, &t);
+    frac = digits == 6 ? us % 1000000 : (us % 1000000) / 1000;
+    n = snprintf(buf, size, "%02d:%02d:%02d.%0*u", t.tm_hour, t.tm_min, t.tm_sec, digits, (unsigned)frac);
+  } else {
+    n = snprintf(buf, size, "%*u.%0*u", CLOCK_STAMP_CHARS - 4, (unsigned)(stamp / 1000000), digits, (unsigned)frac);
+  }
+  if (n < 0) return 0;
+  return (size_t)n < size ? n : size - 1;
+}
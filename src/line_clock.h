@@ -0,0 +1,48 @@
+/**
+ * @file line_clock.h
+ *
+ * @brief time base for the line stamps. Lines are stamped with esp_timer_get_time() (microseconds since boot) in
+ * the ingest task, this class turns such a stamp into text. Once sntp has set the system time the stamps are
+ * anchored to wall clock time, until then (or without a time server) they are shown as seconds since boot.
+ */
+
+#ifndef LINE_CLOCK_H
+#define LINE_CLOCK_H
+
+#include <Arduino.h>
+
+#define CLOCK_ANCHOR_MS 60000 // re-read the sntp disciplined system time, follows drift corrections
+#define CLOCK_STAMP_CHARS 12  // "hh:mm:ss.mmm" and "sssssss.mmm" (right aligned) have the same width
+
+class LineClock {
+public:
+  LineClock();
+
+  // server nullptr or "" keeps the stamps relative to boot, tz is a posix TZ string like "CET-1CEST,M3.5.0,M10.5.0/3"
+  void begin(const char *ntpServer, const char *tz);
+
+  // call once per loop pass
+  void handle();
+
+  bool anchored() const { return offset != 0; }
+
+  // add to a stamp for unix time in microseconds, 0 while not anchored
+  int64_t epochOffset() const { return offset; }
+
+  // stamp as text with 3 (ms) or 6 (us) fractional digits, returns the length written
+  size_t format(int64_t stamp, char *buf, size_t size, uint8_t digits = 3) const {
+    return format(stamp, buf, size, digits, offset);
+  }
+
+  // the same with an epochOffset() read earlier, the text does not change when the clock is re-anchored
+  size_t format(int64_t stamp, char *buf, size_t size, uint8_t digits, int64_t anchor) const;
+
+private:
+  int64_t offset;
+  uint32_t nextCheck;
+  bool enabled;
+};
+
+extern LineClock lineClock;
+
+#endif
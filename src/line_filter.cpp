@@ -0,0 +1,136 @@
+/**
+ * @file line_filter.cpp
+ *
+ * @brief multi pattern line filter, see line_filter.h
+ */
+
+#include "line_filter.h"
+#include "line_assembler.h"
+#include <stdlib.h>
+#include <string.h>
+
+LineFilter::LineFilter()
+  : delta(nullptr), out(nullptr), classes(1), ruleCount(0), includeMask(0), excludeMask(0), highlightMask(0) {
+  memset(cls, 0, sizeof(cls));
+  source[0] = 0;
+}
+
+LineFilter::~LineFilter() {
+  free(delta);
+  free(out);
+}
+
+bool LineFilter::compile(const char *spec) {
+  const char *pattern[FILTER_MAX_RULES];
+  uint8_t length[FILTER_MAX_RULES];
+  uint16_t include = 0, exclude = 0, highlight = 0;
+  uint8_t count = 0;
+  size_t chars = 0;
+
+  size_t specLen = strlen(spec);
+  if (specLen >= FILTER_SPEC_MAX) return false;
+
+  for (const char *p = spec; *p;) {
+    const char *end = strchr(p, '|');
+    if (end == nullptr) end = p + strlen(p);
+    if (end - p < 2 || count == FILTER_MAX_RULES) return false;
+
+    uint16_t bit = 1 << count;
+    if (*p == '+') include |= bit;
+    else if (*p == '-') exclude |= bit;
+    else if (*p == '*') highlight |= bit;
+    else return false;
+
+    pattern[count] = p + 1;
+    length[count] = end - p - 1;
+    chars += length[count];
+    count++;
+    p = *end ? end + 1 : end;
+  }
+  if (chars > FILTER_MAX_CHARS) return false;
+
+  // only characters which occur in a pattern need a column of their own
+  uint8_t newCls[256];
+  uint8_t newClasses = 1;
+  memset(newCls, 0, sizeof(newCls));
+  for (uint8_t r = 0; r < count; r++) {
+    for (uint8_t i = 0; i < length[r]; i++) {
+      uint8_t c = pattern[r][i];
+      if (newCls[c] == 0) newCls[c] = newClasses++;
+    }
+  }
+
+  uint16_t states = chars + 1;
+  uint8_t *newDelta = (uint8_t *)calloc(states * newClasses, 1);
+  uint16_t *newOut = (uint16_t *)calloc(states, sizeof(uint16_t));
+  if (newDelta == nullptr || newOut == nullptr) {
+    free(newDelta);
+    free(newOut);
+    return false;
+  }
+
+  // trie of the patterns - state 0 is the root, which is never the target of a trie edge
+  uint16_t used = 1;
+  for (uint8_t r = 0; r < count; r++) {
+    uint8_t s = 0;
+    for (uint8_t i = 0; i < length[r]; i++) {
+      uint8_t *next = &newDelta[s * newClasses + newCls[(uint8_t)pattern[r][i]]];
+      if (*next == 0) *next = used++;
+      s = *next;
+    }
+    newOut[s] |= 1 << r;
+  }
+
+  // breadth first: failure links, inherited matches and the missing transitions, which turns the trie into a
+  // dfa. a row only holds trie edges until its state is processed, so a non zero entry there is a child
+  uint8_t fail[FILTER_MAX_CHARS + 1];
+  uint8_t queue[FILTER_MAX_CHARS + 1];
+  uint16_t head = 0, tail = 0;
+  fail[0] = 0;
+  queue[tail++] = 0;
+  while (head < tail) {
+    uint8_t s = queue[head++];
+    for (uint8_t c = 0; c < newClasses; c++) {
+      uint8_t &next = newDelta[s * newClasses + c];
+      uint8_t viaFail = s == 0 ? 0 : newDelta[fail[s] * newClasses + c];
+      if (next != 0) {
+        fail[next] = viaFail;
+        newOut[next] |= newOut[viaFail];
+        queue[tail++] = next;
+      } else {
+        next = viaFail;
+      }
+    }
+  }
+
+  free(delta);
+  free(out);
+  delta = newDelta;
+  out = newOut;
+  memcpy(cls, newCls, sizeof(cls));
+  classes = newClasses;
+  ruleCount = count;
+  includeMask = include;
+  excludeMask = exclude;
+  highlightMask = highlight;
+  memcpy(source, spec, specLen + 1);
+  return true;
+}
+
+bool LineFilter::accept(const char *text, size_t len, bool *highlight) const {
+  uint16_t matched = 0;
+
+  *highlight = false;
+  if (ruleCount == 0) return true;
+
+  uint8_t s = 0;
+  for (size_t i = 0; i < len; i++) {
+    if ((uint8_t)text[i] < LINE_FIRST_CHAR) continue; // colour marker, "ERR" + red + "OR" still is ERROR
+    s = delta[s * classes + cls[(uint8_t)text[i]]];
+    matched |= out[s];
+    if (matched & excludeMask) return false;
+  }
+  if (includeMask && !(matched & includeMask)) return false;
+  *highlight = (matched & highlightMask) != 0;
+  return true;
+}
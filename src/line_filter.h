@@ -0,0 +1,59 @@
+/**
+ * @file line_filter.h
+ *
+ * @brief include / exclude / highlight rules for the assembled lines. All patterns are compiled into one
+ * Aho-Corasick automaton, stored as a flat transition table over the characters which occur in the patterns,
+ * so a line is checked in a single pass with one table lookup per byte no matter how many rules there are.
+ * Matching is case sensitive and sees whole lines, before word wrap: a line which is wrapped on screen is
+ * judged once, and all of its rows follow that decision (shown or hidden, highlighted or not). The colour markers
+ * in a line are skipped, a pattern matches across a colour change.
+ * Pure c++ without arduino dependencies like the LineAssembler.
+ *
+ * rule spec: rules separated by '|', the first character selects the action
+ *   +text  include - once there is an include rule only lines containing one of them pass
+ *   -text  exclude - lines containing it never pass, wins over include
+ *   *text  highlight - the line is shown in the highlight colour
+ * e.g. "+ERROR|+assert|-heartbeat|*WARN", "" removes all rules
+ */
+
+#ifndef LINE_FILTER_H
+#define LINE_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FILTER_MAX_RULES 16
+#define FILTER_MAX_CHARS 255 // pattern bytes of all rules together, the automaton has one state per byte
+#define FILTER_SPEC_MAX 160
+
+class LineFilter {
+public:
+  LineFilter();
+  ~LineFilter();
+
+  // replace the rules, false on a malformed spec or when it is too large - the old rules stay then
+  bool compile(const char *spec);
+
+  // the spec of the active rules
+  const char *spec() const { return source; }
+
+  // include or exclude rules exist, so a line can only be judged once it is complete
+  bool filtering() const { return (includeMask | excludeMask) != 0; }
+  uint8_t rules() const { return ruleCount; }
+
+  // true if the line is shown, *highlight tells whether a highlight rule matched
+  bool accept(const char *text, size_t len, bool *highlight) const;
+
+private:
+  uint8_t *delta;           // states x classes, next state for each character class
+  uint16_t *out;            // per state: rules matched when it is reached, including those of its suffixes
+  uint8_t cls[256];         // character class, 0 for characters in no pattern
+  uint8_t classes;
+  uint8_t ruleCount;
+  uint16_t includeMask;
+  uint16_t excludeMask;
+  uint16_t highlightMask;
+  char source[FILTER_SPEC_MAX];
+};
+
+#endif
@@ -0,0 +1,156 @@
+/**
+ * @file line_renderer.cpp
+ *
+ * @brief line sprite rendering, see line_renderer.h
+ */
+
+#include "line_renderer.h"
+
+LineRenderer::LineRenderer(TFT_eSPI *display)
+  : tft(display), spriteA(display), spriteB(display), cur(0), inFlight(-1), ready(false), dma(false),
+    lineWidth(0), lineHeight(0), baseline(0), drawn(0), cursorX(0), ink(TFT_WHITE), pen(TFT_WHITE),
+    fresh(true), areaTop(0), areaEnd(INT16_MAX), face(nullptr), atlasPending(false) {
+  sprite[0] = &spriteA;
+  sprite[1] = &spriteB;
+  memset(adv, 6, sizeof(adv));
+}
+
+bool LineRenderer::begin(int16_t width, int16_t height, const GFXfont *font, const uint8_t *advances) {
+  flush();
+
+  ready = true;
+  for (uint8_t i = 0; i < 2; i++) {
+    TFT_eSprite *s = sprite[i];
+    if (s->created()) s->deleteSprite();
+    s->setColorDepth(16);
+    // the second sprite is only needed to overlap drawing with a dma transfer
+    if (i == 0 || dma) ready = ready && s->createSprite(width, height) != nullptr;
+    if (font) s->setFreeFont(font);
+    else s->setTextFont(1);
+    s->setTextColor(ink);
+  }
+  lineWidth = width;
+  lineHeight = height;
+
+  baseline = 0;
+  if (font) {
+    // free fonts are drawn from the baseline - place it below the tallest printable glyph
+    for (uint16_t c = font->first; c <= font->last; c++) {
+      int16_t ascent = -(int8_t)font->glyph[c - font->first].yOffset;
+      if (ascent > baseline) baseline = ascent;
+    }
+    if (baseline > height - 1) baseline = height - 1;
+  }
+
+  if (advances) {
+    memcpy(adv, advances, sizeof(adv));
+  } else {
+    char str[2] = {0, 0};
+    for (uint8_t i = 0; i < LINE_GLYPHS; i++) {
+      str[0] = LINE_FIRST_CHAR + i;
+      adv[i] = sprite[0]->textWidth(str);
+    }
+  }
+
+  // keep the atlas only while its font stays selected, any other one is built when the first glyph is drawn
+  if (!font || !atlas.matches(font, height)) atlas.release();
+  face = font;
+  atlasPending = font && !atlas.ready();
+
+  cur = 0;
+  pen = ink;
+  sprite[cur]->fillSprite(TFT_BLACK);
+  drawn = 0;
+  cursorX = 0;
+  fresh = true;
+  return ready;
+}
+
+void LineRenderer::update(const char *text, size_t len, int16_t y) {
+  if (!ready || (len <= drawn && !fresh)) return;
+
+  waitFor(cur); // do not draw into pixels which are still being sent
+
+  if (atlasPending && drawn < len) {
+    atlasPending = false; // one attempt per font selection, drawChar carries on if memory is short
+    atlas.build(tft, face, adv, lineHeight, baseline);
+  }
+
+  TFT_eSprite *s = sprite[cur];
+  uint16_t *pixels = (uint16_t *)s->getPointer();
+  int16_t from = cursorX;
+  for (; drawn < len; drawn++) {
+    uint8_t c = text[drawn];
+    if (c < LINE_FIRST_CHAR) { // colour marker
+      pen = AnsiDecoder::rgb565(c - LINE_COLOUR_MARKER, ink);
+      s->setTextColor(pen);
+      continue;
+    }
+    if (atlas.ready() && c < LINE_FIRST_CHAR + LINE_GLYPHS) {
+      atlas.blit(pixels, lineWidth, cursorX, c, pen);
+      cursorX += adv[c - LINE_FIRST_CHAR];
+    } else {
+      cursorX += s->drawChar(c, cursorX, baseline);
+    }
+  }
+  int16_t to = cursorX < lineWidth ? cursorX : lineWidth;
+
+  if (fresh || dma) { // dma needs a contiguous buffer, so the whole line goes out - the cpu is free again right away
+    from = 0;
+    to = lineWidth;
+    fresh = false;
+  }
+  if (to > from) push(from, to, y);
+}
+
+// split the push where the line crosses the end of the scroll area
+void LineRenderer::push(int16_t from, int16_t to, int16_t y) {
+  int16_t rows = lineHeight;
+  if (y + rows > areaEnd) rows = areaEnd - y;
+
+  pushRows(from, to, y, 0, rows);
+  if (rows < lineHeight) pushRows(from, to, areaTop, rows, lineHeight - rows);
+}
+
+void LineRenderer::pushRows(int16_t from, int16_t to, int16_t y, int16_t firstRow, int16_t rows) {
+  TFT_eSprite *s = sprite[cur];
+
+  if (dma) {
+    if (inFlight < 0) tft->startWrite();
+    tft->pushImageDMA(0, y, lineWidth, rows, (uint16_t *)s->getPointer() + firstRow * lineWidth);
+    inFlight = cur;
+  } else {
+    s->pushSprite(from, y, from, firstRow, to - from, rows);
+  }
+}
+
+void LineRenderer::setColour(uint16_t colour) {
+  ink = colour;
+  pen = colour;
+  spriteA.setTextColor(colour);
+  spriteB.setTextColor(colour);
+}
+
+void LineRenderer::newLine() {
+  if (ready && dma) cur ^= 1;
+  waitFor(cur);
+  if (ready) {
+    sprite[cur]->fillSprite(TFT_BLACK);
+    sprite[cur]->setTextColor(ink); // markers of the previous line do not carry over
+  }
+  pen = ink;
+  drawn = 0;
+  cursorX = 0;
+  fresh = true;
+}
+
+void LineRenderer::flush() {
+  if (inFlight < 0) return;
+  tft->dmaWait();
+  tft->endWrite();
+  inFlight = -1;
+}
+
+void LineRenderer::waitFor(uint8_t buffer) {
+  if (inFlight == buffer) tft->dmaWait();
+}
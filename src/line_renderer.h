@@ -0,0 +1,80 @@
+/**
+ * @file line_renderer.h
+ *
+ * @brief renders the current text line into a line sized sprite and pushes it with one windowed write, instead of
+ * one drawChar (and several small spi transactions) per received byte.
+ * With dma enabled two line sprites are used: one is on the spi bus while the next line is drawn into the other.
+ * Any other display access has to call flush() first, the bus is held until the transfer is done.
+ * The first push of a line always covers the full width, which also clears the row - no separate fillRect needed.
+ * Free font glyphs are copied from a GlyphAtlas built on the first line drawn with the font, drawChar is only
+ * used for the glcd font or when there is no memory for the atlas.
+ */
+
+#ifndef LINE_RENDERER_H
+#define LINE_RENDERER_H
+
+#include <TFT_eSPI.h>
+#include "glyph_atlas.h"
+#include "line_assembler.h"
+
+class LineRenderer {
+public:
+  explicit LineRenderer(TFT_eSPI *display);
+
+  // (re)create the sprites for a line of width x height pixels. font == nullptr selects the glcd font 1.
+  // advances: glyph advances of the font (see text_layout.h), nullptr measures them
+  bool begin(int16_t width, int16_t height, const GFXfont *font, const uint8_t *advances = nullptr);
+
+  // push lines with dma, tft.initDMA() must have succeeded
+  void enableDma(bool on) { dma = on; }
+
+  // rows of the hardware scroll area, a line crossing areaEnd continues at areaTop
+  void setScrollArea(int16_t top, int16_t end) { areaTop = top; areaEnd = end; }
+
+  // glyph advance table for the LineAssembler, valid after begin()
+  const uint8_t *advances() const { return adv; }
+
+  // draw text[0..len) - glyphs already in the sprite are kept, only the new ones are rendered and pushed to row y.
+  // a fresh line is pushed even without glyphs, this clears its row
+  void update(const char *text, size_t len, int16_t y);
+
+  // default text colour of the lines, e.g. per capture channel. colour markers in the text switch away from it
+  // until the end of the line
+  void setColour(uint16_t colour);
+
+  // continue in the other (blank) sprite with the next line
+  void newLine();
+
+  // wait for a running dma transfer and release the bus
+  void flush();
+
+private:
+  void waitFor(uint8_t buffer);
+  void push(int16_t from, int16_t to, int16_t y);
+  void pushRows(int16_t from, int16_t to, int16_t y, int16_t firstRow, int16_t rows);
+
+  TFT_eSPI *tft;
+  TFT_eSprite spriteA;
+  TFT_eSprite spriteB;
+  TFT_eSprite *sprite[2];
+  uint8_t cur;      // sprite of the line being drawn
+  int8_t inFlight;  // sprite currently on the bus, -1 = none
+  bool ready;
+  bool dma;
+  int16_t lineWidth;
+  int16_t lineHeight;
+  int16_t baseline; // y of the glyph origin inside the sprite (0 for glcd, ascent for free fonts)
+  size_t drawn;     // characters already rendered into the current sprite
+  int16_t cursorX;
+  uint16_t ink;     // default text colour
+  uint16_t pen;     // colour of the next glyph
+  bool fresh;       // nothing of the current line has reached the display yet
+  int16_t areaTop;
+  int16_t areaEnd;
+  uint8_t adv[LINE_GLYPHS];
+  const GFXfont *face;  // free font of the lines, nullptr = glcd
+  bool atlasPending;    // build the atlas before the next glyph
+  GlyphAtlas atlas;
+};
+
+#endif
@@ -0,0 +1,77 @@
+/**
+ * @file monitor_stats.cpp
+ *
+ * @brief per core counters and loop time histogram, see monitor_stats.h
+ */
+
+#include "monitor_stats.h"
+
+static const uint32_t bounds[STATS_LOOP_BUCKETS] = {100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, UINT32_MAX};
+
+MonitorStats stats;
+
+MonitorStats::MonitorStats() : sampledAt(0) {
+  for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+    for (uint8_t c = 0; c < STAT_COUNTERS; c++) slot[core][c].store(0, std::memory_order_relaxed);
+  }
+  for (uint8_t i = 0; i < STATS_LOOP_BUCKETS; i++) hist[i].store(0, std::memory_order_relaxed);
+  memset(total, 0, sizeof(total));
+  memset(histTotal, 0, sizeof(histTotal));
+  memset(rxTotal, 0, sizeof(rxTotal));
+  memset(&snap, 0, sizeof(snap));
+}
+
+uint32_t MonitorStats::bucketBound(uint8_t i) {
+  return bounds[i < STATS_LOOP_BUCKETS ? i : STATS_LOOP_BUCKETS - 1];
+}
+
+void MonitorStats::loopTime(uint32_t us) {
+  uint8_t i = 0;
+  while (us >= bounds[i] && i < STATS_LOOP_BUCKETS - 1) i++;
+  hist[i].fetch_add(1, std::memory_order_relaxed);
+}
+
+void MonitorStats::sample(UartIngest *const *channels, uint8_t count) {
+  uint32_t now = millis();
+  uint32_t ms = now - sampledAt;
+  if (ms == 0) return;
+  sampledAt = now;
+
+  for (uint8_t c = 0; c < STAT_COUNTERS; c++) {
+    uint32_t sum = 0;
+    for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) sum += slot[core][c].load(std::memory_order_relaxed);
+    snap.perSec[c] = (uint64_t)(sum - total[c]) * 1000 / ms;
+    total[c] = sum;
+  }
+
+  snap.loops = 0;
+  for (uint8_t i = 0; i < STATS_LOOP_BUCKETS; i++) {
+    uint32_t n = hist[i].load(std::memory_order_relaxed);
+    snap.loopHist[i] = n - histTotal[i];
+    histTotal[i] = n;
+    snap.loops += snap.loopHist[i];
+  }
+
+  snap.loopP99Us = 0;
+  snap.loopMaxUs = 0;
+  uint32_t seen = 0;
+  for (uint8_t i = 0; i < STATS_LOOP_BUCKETS; i++) {
+    seen += snap.loopHist[i];
+    if (snap.loopP99Us == 0 && snap.loops > 0 && (uint64_t)seen * 100 >= (uint64_t)snap.loops * 99) {
+      snap.loopP99Us = bounds[i];
+    }
+    if (snap.loopHist[i]) snap.loopMaxUs = bounds[i];
+  }
+
+  for (uint8_t ch = 0; ch < STATS_CHANNELS; ch++) {
+    if (ch >= count) {
+      snap.rxPerSec[ch] = 0;
+      snap.lost[ch] = 0;
+      continue;
+    }
+    IngestStats s = channels[ch]->stats();
+    snap.rxPerSec[ch] = (uint64_t)(s.bytesIn - rxTotal[ch]) * 1000 / ms;
+    snap.lost[ch] = s.fifoOverflows + s.driverFull + s.ringDropped;
+    rxTotal[ch] = s.bytesIn;
+  }
+}
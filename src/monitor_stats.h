@@ -0,0 +1,70 @@
+/**
+ * @file monitor_stats.h
+ *
+ * @brief cheap instrumentation of the monitor itself. Hot paths only do a relaxed atomic add into the counter
+ * slot of the core they run on, so the ingest tasks on core 0 and the main loop on core 1 never contend for a
+ * cache line or a lock. sample() folds the slots together once per second and keeps per second values of the
+ * last interval, together with the byte counters of the uart channels and a histogram of the loop pass time.
+ */
+
+#ifndef MONITOR_STATS_H
+#define MONITOR_STATS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "uart_ingest.h"
+
+#define STATS_CHANNELS 2
+#define STATS_LOOP_BUCKETS 10
+
+enum StatCounter {
+  STAT_LINES,     // lines assembled
+  STAT_RENDERED,  // lines drawn on the display
+  STAT_RENDER_US, // time spent rendering and pushing lines
+  STAT_SCROLL_US, // time spent in scroll_line()
+  STAT_COUNTERS
+};
+
+struct StatsSnapshot {
+  uint32_t rxPerSec[STATS_CHANNELS];
+  uint32_t lost[STATS_CHANNELS]; // bytes lost since boot (fifo, driver and ring overruns)
+  uint32_t perSec[STAT_COUNTERS];
+  uint32_t loops;                // loop passes in the interval
+  uint32_t loopP99Us;            // upper bound of the bucket holding the 99th percentile
+  uint32_t loopMaxUs;            // upper bound of the slowest non-empty bucket
+  uint32_t loopHist[STATS_LOOP_BUCKETS];
+};
+
+class MonitorStats {
+public:
+  MonitorStats();
+
+  // from any core
+  void count(StatCounter c, uint32_t n = 1) {
+    slot[xPortGetCoreID()][c].fetch_add(n, std::memory_order_relaxed);
+  }
+
+  // duration of one main loop pass
+  void loopTime(uint32_t us);
+
+  // close the interval, call once per second
+  void sample(UartIngest *const *channels, uint8_t count);
+
+  const StatsSnapshot &last() const { return snap; }
+
+  // upper bound of loop time bucket i in microseconds, UINT32_MAX for the last one
+  static uint32_t bucketBound(uint8_t i);
+
+private:
+  std::atomic<uint32_t> slot[portNUM_PROCESSORS][STAT_COUNTERS];
+  std::atomic<uint32_t> hist[STATS_LOOP_BUCKETS];
+  uint32_t total[STAT_COUNTERS];
+  uint32_t histTotal[STATS_LOOP_BUCKETS];
+  uint32_t rxTotal[STATS_CHANNELS];
+  uint32_t sampledAt;
+  StatsSnapshot snap;
+};
+
+extern MonitorStats stats;
+
+#endif
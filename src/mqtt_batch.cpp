@@ -0,0 +1,95 @@
+/**
+ * @file mqtt_batch.cpp
+ *
+ * @brief batched line publishing, see mqtt_batch.h
+ */
+
+#include "mqtt_batch.h"
+
+#define MQTT_HEADER_OVERHEAD 7 // fixed header with remaining length (5) plus the topic length field (2)
+#define MQTT_STAMP_CHARS 24    // "<us> <ch> " in front of a line
+
+MqttBatcher::MqttBatcher()
+  : mqtt(nullptr), history(nullptr), timeBase(nullptr), buf(nullptr), cap(0), cursor(0), pendingSince(0), batches(0), gaps(0) {
+  topicName[0] = 0;
+}
+
+bool MqttBatcher::begin(MqttLink *link, LineHistory *lines, size_t packetSize) {
+  mqtt = link;
+  history = lines;
+  snprintf(topicName, sizeof(topicName), "serialmonitor/%s/log", mqtt->clientId());
+
+  size_t overhead = MQTT_HEADER_OVERHEAD + strlen(topicName);
+  if (packetSize <= overhead + 128 || !mqtt->client().setBufferSize(packetSize)) return false;
+  cap = packetSize - overhead;
+  buf = (char *)malloc(cap);
+  cursor = history->first(); // lines captured before the first connection are published as well
+  return buf != nullptr;
+}
+
+void MqttBatcher::handle() {
+  if (buf == nullptr) return;
+
+  if (history->end() == cursor) {
+    pendingSince = millis();
+    return;
+  }
+  if (!mqtt->connected()) return;
+
+  for (uint8_t i = 0; i < MQTT_BATCHES_PER_PASS && due(); i++) {
+    if (!publishBatch()) break;
+    pendingSince = millis();
+  }
+}
+
+// a full packet worth of lines is waiting, or the oldest one waited long enough
+bool MqttBatcher::due() {
+  if (history->end() == cursor) return false;
+  if (millis() - pendingSince >= MQTT_BATCH_MS) return true;
+
+  size_t bytes = 64; // header
+  for (uint32_t seq = cursor; seq != history->end(); seq++) {
+    const char *text;
+    size_t len;
+    if (history->get(seq, &text, &len)) bytes += len + 1 + MQTT_STAMP_CHARS;
+    if (bytes >= cap) return true;
+  }
+  return false;
+}
+
+bool MqttBatcher::publishBatch() {
+  uint32_t gap = 0;
+  if ((int32_t)(history->first() - cursor) > 0) { // evicted while we were offline
+    gap = history->first() - cursor;
+    cursor = history->first();
+  }
+
+  int n = snprintf(buf, cap, "S%u T%u", (unsigned)cursor, (unsigned)millis());
+  if (gap) n += snprintf(buf + n, cap - n, " G%u", (unsigned)gap);
+  if (timeBase && timeBase->anchored()) n += snprintf(buf + n, cap - n, " E%lld", (long long)timeBase->epochOffset());
+
+  uint32_t seq = cursor;
+  for (; seq != history->end(); seq++) {
+    const char *text;
+    size_t len;
+    int64_t stamp;
+    uint8_t channel;
+    if (!history->get(seq, &text, &len, &stamp, &channel)) break;
+    if (n + 1 + MQTT_STAMP_CHARS + len > cap) {
+      if (seq != cursor) break;
+      len = cap - n - 1 - MQTT_STAMP_CHARS; // a single line longer than a packet is cut
+    }
+    buf[n++] = '\n';
+    n += snprintf(buf + n, MQTT_STAMP_CHARS + 1, "%lld %u ", (long long)stamp, channel);
+    n += stripMarkers(buf + n, text, len);
+  }
+
+  if (!mqtt->client().publish(topicName, (const uint8_t *)buf, n)) {
+    if (gap) cursor -= gap; // report the gap again with the next attempt
+    return false;
+  }
+  gaps += gap;
+  batches++;
+  cursor = seq;
+  return true;
+}
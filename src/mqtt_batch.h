@@ -0,0 +1,61 @@
+/**
+ * @file mqtt_batch.h
+ *
+ * @brief publishes the captured lines to serialmonitor/<client id>/log in batches. A cursor walks the history,
+ * so nothing is copied until a batch is built, and after a broker or wifi outage publishing resumes where it
+ * stopped (as long as the history still holds the lines - otherwise the gap is reported in the next header).
+ * A batch goes out once it would fill a packet or its oldest line waited MQTT_BATCH_MS.
+ *
+ * payload framing, one text line per captured line, each with its receive time in microseconds since boot and
+ * its capture channel (0 = serial2, 1 = serial1):
+ *   S<seq of the first line> T<uptime ms>[ G<lines lost before seq>][ E<unix time of boot in us>]\n<us> <ch> <line>...
+ * E is only present once the clock is ntp anchored, unix time of a line is E + us.
+ */
+
+#ifndef MQTT_BATCH_H
+#define MQTT_BATCH_H
+
+#include <Arduino.h>
+#include "mqtt_link.h"
+#include "history.h"
+#include "line_clock.h"
+#include "line_assembler.h"
+
+#define MQTT_BATCH_MS 1000
+#define MQTT_BATCHES_PER_PASS 4 // bounds loop time while catching up after an outage
+
+class MqttBatcher {
+public:
+  MqttBatcher();
+
+  // packetSize: mqtt packet limit, the PubSubClient buffer is resized to it
+  bool begin(MqttLink *link, LineHistory *lines, size_t packetSize);
+
+  // wall clock anchor for the E header field, nullptr leaves it out
+  void setClock(const LineClock *clock) { timeBase = clock; }
+
+  // call once per loop pass
+  void handle();
+
+  const char *topic() const { return topicName; }
+  uint32_t published() const { return batches; }
+  uint32_t skipped() const { return gaps; }                // lines evicted before they could be published
+  uint32_t backlog() const { return history->end() - cursor; }
+
+private:
+  bool due();
+  bool publishBatch();
+
+  MqttLink *mqtt;
+  LineHistory *history;
+  const LineClock *timeBase;
+  char topicName[64];
+  char *buf;
+  size_t cap;            // payload bytes per batch
+  uint32_t cursor;       // next line to publish
+  uint32_t pendingSince; // millis() when the oldest unpublished line was seen
+  uint32_t batches;
+  uint32_t gaps;
+};
+
+#endif
@@ -0,0 +1,124 @@
+/**
+ * @file mqtt_link.cpp
+ *
+ * @brief mqtt connection state machine, see mqtt_link.h
+ */
+
+#include "mqtt_link.h"
+
+MqttLink::MqttLink()
+  : pubsub(net), host(""), user(""), pass(""), subscription(nullptr), port(1883), resolved(false), lookup(LOOKUP_IDLE),
+    found(0), lookupSince(0), st(MQTT_OFFLINE), backoff(MQTT_BACKOFF_MIN_MS), nextTry(0) {
+  id[0] = 0;
+}
+
+void MqttLink::begin(const char *server, uint16_t serverPort, const char *username, const char *password,
+                     MQTT_CALLBACK_SIGNATURE) {
+  host = server;
+  port = serverPort;
+  user = username;
+  pass = password;
+  resolved = ip.fromString(host);
+
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  snprintf(id, sizeof(id), "SerialMonitor_%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+  pubsub.setCallback(callback);
+  pubsub.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+  st = MQTT_WAITING;
+  nextTry = millis();
+}
+
+void MqttLink::handle() {
+  if (WiFi.status() != WL_CONNECTED) {
+    if (st == MQTT_CONNECTED) pubsub.disconnect();
+    st = MQTT_OFFLINE;
+    return;
+  }
+
+  if (st == MQTT_OFFLINE) { // wifi is back, try right away
+    st = MQTT_WAITING;
+    resolved = ip.fromString(host); // the network may be another one, look the broker up again
+    backoff = MQTT_BACKOFF_MIN_MS;
+    nextTry = millis();
+  }
+
+  if (st == MQTT_CONNECTED) {
+    if (pubsub.loop()) return;
+    st = MQTT_WAITING; // connection lost
+    backoff = MQTT_BACKOFF_MIN_MS;
+    nextTry = millis() + backoff;
+    return;
+  }
+
+  if ((int32_t)(millis() - nextTry) < 0) return;
+  if (!resolved && !resolve()) return;
+
+  if (attempt()) {
+    st = MQTT_CONNECTED;
+    backoff = MQTT_BACKOFF_MIN_MS;
+    if (subscription) pubsub.subscribe(subscription);
+  } else {
+    fail();
+  }
+}
+
+// start or poll the lookup of the broker name, true once its address is known. WiFi.hostByName() would wait for
+// the answer on the loop task, without a bound
+bool MqttLink::resolve() {
+  switch (lookup.load()) {
+  case LOOKUP_IDLE: {
+    ip_addr_t addr;
+    lookupSince = millis();
+    lookup = LOOKUP_RUNNING; // before the call, the callback may come before it returns
+    err_t err = dns_gethostbyname(host, &addr, dnsFound, this);
+    if (err == ERR_INPROGRESS) return false;
+    if (err != ERR_OK) {
+      lookup = LOOKUP_IDLE;
+      fail();
+      return false;
+    }
+    found = ip_2_ip4(&addr)->addr; // cached by lwip, no callback
+    break;
+  }
+  case LOOKUP_RUNNING:
+    if (millis() - lookupSince >= MQTT_DNS_TIMEOUT_MS) fail();
+    return false;
+  case LOOKUP_FAILED:
+    lookup = LOOKUP_IDLE;
+    fail();
+    return false;
+  case LOOKUP_DONE:
+    break;
+  }
+
+  ip = IPAddress(found);
+  lookup = LOOKUP_IDLE;
+  resolved = true;
+  return true;
+}
+
+// runs in the tcpip task, addr is nullptr if the name could not be resolved
+void MqttLink::dnsFound(const char *name, const ip_addr_t *addr, void *arg) {
+  MqttLink *link = (MqttLink *)arg;
+  if (addr) link->found = ip_2_ip4(addr)->addr;
+  link->lookup = addr ? LOOKUP_DONE : LOOKUP_FAILED;
+}
+
+// one bounded connection attempt
+bool MqttLink::attempt() {
+  if (!net.connected() && !net.connect(ip, port, MQTT_CONNECT_TIMEOUT_MS)) return false;
+
+  pubsub.setServer(ip, port);
+  // PubSubClient reuses the connected socket and only waits for the CONNACK
+  if (user[0]) return pubsub.connect(id, user, pass);
+  return pubsub.connect(id);
+}
+
+// exponential backoff with some jitter, so a fleet of monitors does not hammer a recovering broker in sync
+void MqttLink::fail() {
+  net.stop();
+  nextTry = millis() + backoff / 2 + random(backoff / 2 + 1);
+  backoff = backoff * 2 > MQTT_BACKOFF_MAX_MS ? MQTT_BACKOFF_MAX_MS : backoff * 2;
+}
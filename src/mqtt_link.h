@@ -0,0 +1,77 @@
+/**
+ * @file mqtt_link.h
+ *
+ * @brief non-blocking connection management for PubSubClient. handle() runs a small state machine from the main
+ * loop: a failed attempt schedules the next one with exponential backoff instead of delay()ing, and the device is
+ * never restarted because of a broker outage. One attempt is bounded by MQTT_CONNECT_TIMEOUT_MS for the tcp
+ * connect plus MQTT_SOCKET_TIMEOUT_S for the CONNACK, the uart keeps being drained into the ingest ring meanwhile.
+ * The broker name is looked up once after every wifi connect with the asynchronous lwip resolver - the answer
+ * arrives from the tcpip task while the loop goes on - and its address is kept for all attempts until wifi drops.
+ */
+
+#ifndef MQTT_LINK_H
+#define MQTT_LINK_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include <lwip/dns.h>
+#include <atomic>
+
+#define MQTT_BACKOFF_MIN_MS 1000
+#define MQTT_BACKOFF_MAX_MS 120000
+#define MQTT_CONNECT_TIMEOUT_MS 1000
+#define MQTT_SOCKET_TIMEOUT_S 1
+#define MQTT_DNS_TIMEOUT_MS 5000 // a lookup taking longer counts as a failed attempt, a late answer is still used
+
+class MqttLink {
+public:
+  enum State {
+    MQTT_OFFLINE,   // no wifi
+    MQTT_WAITING,   // backing off until the next attempt
+    MQTT_CONNECTED
+  };
+
+  MqttLink();
+
+  // user / password may be empty for brokers without authentication
+  void begin(const char *server, uint16_t port, const char *user, const char *password, MQTT_CALLBACK_SIGNATURE);
+
+  // call once per loop pass
+  void handle();
+
+  // topic (re)subscribed after every successful connect
+  void subscribe(const char *topic) { subscription = topic; }
+
+  bool connected() { return pubsub.connected(); }
+  State state() const { return st; }
+  const char *clientId() const { return id; }
+  PubSubClient &client() { return pubsub; }
+
+private:
+  enum Lookup : uint8_t { LOOKUP_IDLE, LOOKUP_RUNNING, LOOKUP_DONE, LOOKUP_FAILED };
+
+  bool resolve();
+  bool attempt();
+  void fail();
+  static void dnsFound(const char *name, const ip_addr_t *addr, void *arg);
+
+  WiFiClient net;
+  PubSubClient pubsub;
+  const char *host;
+  const char *user;
+  const char *pass;
+  const char *subscription;
+  uint16_t port;
+  IPAddress ip;
+  bool resolved;
+  std::atomic<uint8_t> lookup; // Lookup, set to done / failed by the resolver callback
+  uint32_t found;              // address from the callback, valid once lookup is LOOKUP_DONE
+  uint32_t lookupSince;
+  char id[32];
+  State st;
+  uint32_t backoff;   // current retry interval
+  uint32_t nextTry;   // millis() of the next attempt
+};
+
+#endif
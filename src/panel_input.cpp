@@ -0,0 +1,84 @@
+/**
+ * @file panel_input.cpp
+ *
+ * @brief encoder interrupt and expander task, see panel_input.h
+ */
+
+#include "panel_input.h"
+
+static const uint8_t buttonPin[PANEL_BUTTONS] = {PANEL_PAUSE_PIN, PANEL_MARK_PIN, PANEL_MENU_PIN};
+
+PanelInput::PanelInput() : knob(nullptr), steps(0), events(nullptr), task(nullptr) {}
+
+bool PanelInput::beginKnob(int8_t pinA, int8_t pinB) {
+  if (pinA < 0 || pinB < 0) return false;
+
+  knob = new Rotary(pinA, pinB); // sets the pins up
+  attachInterruptArg(pinA, onKnob, this, CHANGE);
+  attachInterruptArg(pinB, onKnob, this, CHANGE);
+  return true;
+}
+
+bool PanelInput::beginButtons(TwoWire *wire, uint8_t address, int8_t intPin) {
+  if (intPin < 0 || !mcp.begin_I2C(address, wire)) return false;
+
+  mcp.setupInterrupts(true, false, LOW); // INTA follows both ports, driven, low while a change is pending
+  for (uint8_t i = 0; i < PANEL_BUTTONS; i++) {
+    mcp.pinMode(buttonPin[i], INPUT_PULLUP);
+    mcp.setupInterruptPin(buttonPin[i], CHANGE);
+    button[i].attach(mcp, buttonPin[i], PANEL_DEBOUNCE_MS);
+  }
+
+  events = xQueueCreate(PANEL_QUEUE, sizeof(PanelEvent));
+  if (events == nullptr) return false;
+  if (xTaskCreatePinnedToCore(taskEntry, "panel", PANEL_TASK_STACK, this,
+                              PANEL_TASK_PRIORITY, &task, PANEL_TASK_CORE) != pdPASS) return false;
+  pinMode(intPin, INPUT);
+  attachInterruptArg(intPin, onExpander, this, FALLING);
+  return true;
+}
+
+bool PanelInput::read(PanelEvent *event) {
+  return events && xQueueReceive(events, event, 0) == pdTRUE;
+}
+
+// one of the encoder pins changed - the state table filters bounce and half steps
+void IRAM_ATTR PanelInput::onKnob(void *arg) {
+  PanelInput *self = static_cast<PanelInput *>(arg);
+  unsigned char r = self->knob->process();
+
+  if (r == DIR_CW) self->steps.fetch_add(1);
+  else if (r == DIR_CCW) self->steps.fetch_sub(1);
+}
+
+// INT went low: a button pin changed, the task reads the port
+void IRAM_ATTR PanelInput::onExpander(void *arg) {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(static_cast<PanelInput *>(arg)->task, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+void PanelInput::taskEntry(void *arg) {
+  static_cast<PanelInput *>(arg)->run();
+}
+
+// sleeps until INT, then reads the port every PANEL_DEBOUNCE_MS until no button is bouncing any more. reading
+// the port also clears the interrupt
+void PanelInput::run() {
+  bool settling = true; // a change may have been pending before the interrupt was attached
+
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, settling ? pdMS_TO_TICKS(PANEL_DEBOUNCE_MS) : portMAX_DELAY);
+    uint16_t port = mcp.readGPIOAB();
+
+    settling = false;
+    for (uint8_t i = 0; i < PANEL_BUTTONS; i++) {
+      if (button[i].update(port) && button[i].fell()) {
+        PanelEvent e;
+        e.type = (PanelEvent::Type)i;
+        xQueueSend(events, &e, 0); // queue full: the press is dropped
+      }
+      settling |= button[i].settling();
+    }
+  }
+}
@@ -0,0 +1,66 @@
+/**
+ * @file panel_input.h
+ *
+ * @brief hardware controls next to the touch screen: a rotary encoder and push buttons on an MCP23017 port
+ * expander. Neither is polled. The encoder pins raise a pin change interrupt which runs the Rotary state table
+ * right there and counts the detents, the loop only picks up the count. The expander signals button changes on
+ * its (mirrored) INT line, which wakes a task that fetches all 16 port bits with one i2c read and debounces them
+ * with BounceMcp - while nothing is pressed there is no i2c traffic at all. Presses are posted into a queue like
+ * the touch events.
+ */
+
+#ifndef PANEL_INPUT_H
+#define PANEL_INPUT_H
+
+#include <Arduino.h>
+#include <Adafruit_MCP23X17.h>
+#include <Bounce2mcp.h>
+#include <Rotary.h>
+#include <Wire.h>
+#include <atomic>
+
+#define PANEL_BUTTONS 3
+#define PANEL_PAUSE_PIN 0 // expander pins of the buttons (GPA0..), pressed pulls them to ground
+#define PANEL_MARK_PIN 1
+#define PANEL_MENU_PIN 2
+#define PANEL_DEBOUNCE_MS 15
+#define PANEL_QUEUE 8
+#define PANEL_TASK_STACK 2048
+#define PANEL_TASK_PRIORITY 1
+#define PANEL_TASK_CORE 1
+
+struct PanelEvent {
+  enum Type : uint8_t { PAUSE, MARK, MENU } type; // the button which was pressed
+};
+
+class PanelInput {
+public:
+  PanelInput();
+
+  // count the detents of an encoder on pinA / pinB
+  bool beginKnob(int8_t pinA, int8_t pinB);
+
+  // buttons on the expander at address, its INTA line (mirrored, push-pull, active low) goes to intPin
+  bool beginButtons(TwoWire *wire, uint8_t address, int8_t intPin);
+
+  // detents turned since the last call, > 0 clockwise
+  int32_t takeSteps() { return steps.exchange(0); }
+
+  // next button press, false if there is none - costs one queue check
+  bool read(PanelEvent *event);
+
+private:
+  static void IRAM_ATTR onKnob(void *arg);
+  static void IRAM_ATTR onExpander(void *arg);
+  static void taskEntry(void *arg);
+  void run();
+
+  Rotary *knob;
+  std::atomic<int32_t> steps; // written by the pin change interrupt
+  Adafruit_MCP23X17 mcp;
+  BounceMcp button[PANEL_BUTTONS];
+  QueueHandle_t events;
+  TaskHandle_t task;
+};
+
+#endif
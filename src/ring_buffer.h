@@ -0,0 +1,187 @@
+/**
+ * @file ring_buffer.h
+ *
+ * @brief lock-free single producer / single consumer byte ring. The uart ingest task (core 0) is the only writer,
+ * the main loop (core 1) the only reader - so head and tail are each owned by one side and no mutex is needed.
+ * Both indices run freely and are masked on access, capacity therefore has to be a power of two.
+ *
+ * When the ring is full the producer drops the surplus and counts it, so a slow consumer never blocks the uart.
+ * BroadcastRing below is the one writer, many readers variant used to fan data out to network clients.
+ */
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class ByteRing {
+public:
+  ByteRing() : buf(nullptr), mask(0), head(0), tail(0), dropped(0), peak(0) {}
+
+  // storage is owned by the caller, capacity must be a power of two
+  bool begin(uint8_t *storage, size_t capacity) {
+    if (storage == nullptr || capacity == 0 || (capacity & (capacity - 1)) != 0) return false;
+    buf = storage;
+    mask = capacity - 1;
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    dropped.store(0, std::memory_order_relaxed);
+    peak = 0;
+    return true;
+  }
+
+  // detach the storage before the caller frees it, the ring stays empty until the next begin()
+  void end() {
+    buf = nullptr;
+    mask = 0;
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+  }
+
+  size_t capacity() const { return mask + 1; }
+
+  size_t available() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+
+  size_t space() const { return capacity() - available(); }
+
+  /********************************** producer side *****************************************/
+
+  // contiguous free region for zero copy writes (e.g. uart_read_bytes straight into the ring)
+  size_t writeSpan(uint8_t **data) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    uint32_t used = h - tail.load(std::memory_order_acquire);
+    size_t free = capacity() - used;
+    size_t toEnd = capacity() - (h & mask);
+    *data = buf + (h & mask);
+    return free < toEnd ? free : toEnd;
+  }
+
+  // publish len bytes written into the region returned by writeSpan()
+  void commit(size_t len) {
+    uint32_t h = head.load(std::memory_order_relaxed) + len;
+    head.store(h, std::memory_order_release);
+    uint32_t used = h - tail.load(std::memory_order_relaxed);
+    if (used > peak) peak = used;
+  }
+
+  // copy in as much as fits, everything else is counted as overrun
+  size_t write(const uint8_t *data, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+      uint8_t *dst;
+      size_t n = writeSpan(&dst);
+      if (n == 0) break;
+      if (n > len - done) n = len - done;
+      memcpy(dst, data + done, n);
+      commit(n);
+      done += n;
+    }
+    if (done < len) addDropped(len - done);
+    return done;
+  }
+
+  void addDropped(size_t len) { dropped.fetch_add(len, std::memory_order_relaxed); }
+
+  /********************************** consumer side *****************************************/
+
+  // contiguous readable region, call consume() once the bytes have been processed
+  size_t peek(const uint8_t **data) const {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    size_t used = head.load(std::memory_order_acquire) - t;
+    size_t toEnd = capacity() - (t & mask);
+    *data = buf + (t & mask);
+    return used < toEnd ? used : toEnd;
+  }
+
+  void consume(size_t len) {
+    tail.store(tail.load(std::memory_order_relaxed) + len, std::memory_order_release);
+  }
+
+  size_t read(uint8_t *dst, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+      const uint8_t *src;
+      size_t n = peek(&src);
+      if (n == 0) break;
+      if (n > len - done) n = len - done;
+      memcpy(dst + done, src, n);
+      consume(n);
+      done += n;
+    }
+    return done;
+  }
+
+  // free running stream positions of the next byte to write / read, lets side data refer to ring bytes
+  uint32_t writePos() const { return head.load(std::memory_order_relaxed); }
+  uint32_t readPos() const { return tail.load(std::memory_order_relaxed); }
+
+  /********************************** statistics *****************************************/
+
+  uint32_t overruns() const { return dropped.load(std::memory_order_relaxed); }
+  uint32_t highWater() const { return peak; }
+
+private:
+  uint8_t *buf;
+  size_t mask;
+  std::atomic<uint32_t> head; // written by producer only
+  std::atomic<uint32_t> tail; // written by consumer only
+  std::atomic<uint32_t> dropped;
+  uint32_t peak; // producer side fill level maximum
+};
+
+// single producer, many readers in the same task: one copy of the data serves every reader, each keeps its own
+// position. The producer never waits - it overwrites the oldest bytes, a reader which falls more than
+// capacity() behind has lost data and has to skip ahead to writePos(). Capacity has to be a power of two.
+class BroadcastRing {
+public:
+  BroadcastRing() : buf(nullptr), mask(0), head(0) {}
+
+  bool begin(uint8_t *storage, size_t capacity) {
+    if (storage == nullptr || capacity == 0 || (capacity & (capacity - 1)) != 0) return false;
+    buf = storage;
+    mask = capacity - 1;
+    head = 0;
+    return true;
+  }
+
+  size_t capacity() const { return mask + 1; }
+
+  // free running position of the next byte written
+  uint32_t writePos() const { return head; }
+
+  void write(const uint8_t *data, size_t len) {
+    if (len > capacity()) { // only the newest bytes can be kept
+      head += len - capacity();
+      data += len - capacity();
+      len = capacity();
+    }
+    while (len > 0) {
+      size_t toEnd = capacity() - (head & mask);
+      size_t n = len < toEnd ? len : toEnd;
+      memcpy(buf + (head & mask), data, n);
+      head += n;
+      data += n;
+      len -= n;
+    }
+  }
+
+  // contiguous bytes from pos on, pos must not be more than capacity() behind writePos()
+  size_t peek(uint32_t pos, const uint8_t **data) const {
+    size_t used = head - pos;
+    size_t toEnd = capacity() - (pos & mask);
+    *data = buf + (pos & mask);
+    return used < toEnd ? used : toEnd;
+  }
+
+private:
+  uint8_t *buf;
+  size_t mask;
+  uint32_t head;
+};
+
+#endif
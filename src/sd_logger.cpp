@@ -0,0 +1,219 @@
+/**
+ * @file sd_logger.cpp
+ *
+ * @brief double buffered sd card log, see sd_logger.h
+ */
+
+#include "sd_logger.h"
+
+SdLogger::SdLogger()
+  : cs(0), history(nullptr), timeBase(nullptr), task(nullptr), mounted(false), index(0), nextFile(0), fill(0),
+    used(0), synced(0), blockStart(0), cursor(0), lastSync(0), fileStart(0), stageLen(0), stageOff(0), busy(false),
+    frame(nullptr), frameStart(0), bytes(0), failures(0), gaps(0) {
+  block[0] = block[1] = nullptr;
+  job.data = nullptr;
+  job.len = 0;
+  job.offset = 0;
+  job.full = false;
+  job.rotate = false;
+}
+
+bool SdLogger::begin(uint8_t csPin, LineHistory *lines, const LineClock *clock) {
+  cs = csPin;
+  history = lines;
+  timeBase = clock;
+
+  spiBus.lock();
+  bool ok = SD.begin(cs, SPI, SD_SPI_FREQUENCY);
+  if (ok) nextFile = findNextIndex(); // never overwrite the logs of earlier runs
+  spiBus.unlock();
+  if (!ok) return false;
+
+  block[0] = (uint8_t *)malloc(SD_BLOCK_SIZE);
+  block[1] = (uint8_t *)malloc(SD_BLOCK_SIZE);
+  if (block[0] == nullptr || block[1] == nullptr) return false;
+#if SD_COMPRESS
+  frame = (uint8_t *)malloc(SD_FRAME_HEADER + SD_BLOCK_SIZE);
+  if (frame == nullptr) return false;
+#endif
+
+  cursor = history->first(); // lines captured before the card was mounted are logged as well
+  fileStart = lastSync = millis();
+  mounted = xTaskCreatePinnedToCore(taskEntry, "sd_logger", SD_TASK_STACK, this,
+                                    SD_TASK_PRIORITY, &task, SD_TASK_CORE) == pdPASS;
+  return mounted;
+}
+
+void SdLogger::handle() {
+  if (!mounted) return;
+
+  bool empty = blockStart == 0 && used == 0;
+  if (blockStart >= SD_FILE_BYTES || (millis() - fileStart >= SD_FILE_MS && !empty)) {
+    if (submit(used, true, true)) fileStart = millis();
+    return;
+  }
+
+  for (;;) {
+    if (used == SD_BLOCK_SIZE && !submit(used, true, false)) return; // the other buffer is still being written
+    if (stageOff == stageLen && !stageLine()) break;
+
+    size_t n = stageLen - stageOff;
+    if (n > SD_BLOCK_SIZE - used) n = SD_BLOCK_SIZE - used; // lines continue in the next block
+    memcpy(block[fill] + used, stage + stageOff, n);
+    used += n;
+    stageOff += n;
+  }
+
+  // a packed frame is never rewritten - one packing shorter than the last would leave the old tail behind - so
+  // with SD_COMPRESS the sync closes the frame and the next lines start a new one
+  if (used > synced && millis() - lastSync >= SD_SYNC_MS) submit(used, SD_COMPRESS, false);
+}
+
+// next history line as "<stamp> <channel> <text>\n" into the staging buffer
+bool SdLogger::stageLine() {
+  if ((int32_t)(history->first() - cursor) > 0) { // evicted before the card could keep up
+    gaps += history->first() - cursor;
+    cursor = history->first();
+  }
+
+  const char *text;
+  size_t len;
+  int64_t stamp;
+  uint8_t channel;
+  if (cursor == history->end() || !history->get(cursor, &text, &len, &stamp, &channel)) return false;
+  cursor++;
+
+  size_t n = timeBase->format(stamp, stage, 24, 6);
+  stage[n++] = ' ';
+  stage[n++] = '0' + channel;
+  stage[n++] = ' ';
+  if (len > LINE_MAX_TEXT) len = LINE_MAX_TEXT;
+  n += stripMarkers(stage + n, text, len);
+  stage[n++] = '\n';
+  stageLen = n;
+  stageOff = 0;
+  return true;
+}
+
+// hand block[fill] to the writer task. a full block is done with, a partial one stays in place and is
+// filled further - the writer only reads the bytes below len, so both sides can work on it at once
+bool SdLogger::submit(size_t len, bool full, bool rotate) {
+  if (busy.load(std::memory_order_acquire)) return false;
+
+  job.data = block[fill];
+  job.len = len;
+  job.offset = blockStart;
+  job.full = full;
+  job.rotate = rotate;
+  busy.store(true, std::memory_order_release);
+  xTaskNotifyGive(task);
+  lastSync = millis();
+
+  if (full) {
+    blockStart = rotate ? 0 : blockStart + len;
+    fill ^= 1;
+    used = 0;
+    synced = 0;
+  } else {
+    synced = len;
+  }
+  return true;
+}
+
+void SdLogger::taskEntry(void *arg) {
+  static_cast<SdLogger *>(arg)->run();
+}
+
+void SdLogger::run() {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    writeJob();
+    busy.store(false, std::memory_order_release);
+  }
+}
+
+// the bus is taken per slice, so the display gets its turn between them even while the card is slow
+void SdLogger::writeJob() {
+  if (!file && !openNext()) {
+    failures++;
+    mounted = false;
+    return;
+  }
+
+  const uint8_t *data = job.data;
+  size_t len = job.len;
+  uint32_t offset = job.offset;
+#if SD_COMPRESS
+  data = frame;
+  len = packFrame();
+  offset = frameStart;
+#endif
+
+  spiBus.lock();
+  bool ok = file.seek(offset);
+  spiBus.unlock();
+
+  for (size_t off = 0; ok && off < len; off += SD_SLICE) {
+    size_t n = len - off < SD_SLICE ? len - off : SD_SLICE;
+    spiBus.lock();
+    ok = file.write(data + off, n) == n;
+    spiBus.unlock();
+  }
+
+  spiBus.lock();
+  file.flush(); // directory entry and fat are updated, this is what survives a power loss
+  if (!ok || job.rotate) file.close();
+  spiBus.unlock();
+
+  if (ok) {
+    bytes += len;
+    if (job.full) frameStart = job.rotate ? 0 : frameStart + len;
+  } else {
+    failures++;
+    mounted = false; // card removed or full
+  }
+}
+
+// the job's block as a frame, packed outside of the bus lock. an empty block leaves no frame
+size_t SdLogger::packFrame() {
+  if (job.len == 0) return 0;
+
+  size_t packed = codec.pack(job.data, job.len, frame + SD_FRAME_HEADER, job.len - 1);
+  if (packed == 0) { // does not shrink, e.g. a lot of binary noise
+    memcpy(frame + SD_FRAME_HEADER, job.data, job.len);
+    packed = job.len;
+  }
+  frame[0] = 'L';
+  frame[1] = 'B';
+  frame[2] = job.len & 0xff;
+  frame[3] = job.len >> 8;
+  frame[4] = packed & 0xff;
+  frame[5] = packed >> 8;
+  return SD_FRAME_HEADER + packed;
+}
+
+bool SdLogger::openNext() {
+  char name[16];
+
+  snprintf(name, sizeof(name), SD_COMPRESS ? "/log%05u.lzb" : "/log%05u.txt", nextFile);
+  spiBus.lock();
+  file = SD.open(name, FILE_WRITE);
+  spiBus.unlock();
+  if (!file) return false;
+  index = nextFile++;
+  return true;
+}
+
+uint16_t SdLogger::findNextIndex() {
+  uint16_t next = 0;
+  File root = SD.open("/");
+  if (!root) return 0;
+
+  for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+    const char *name = f.name();
+    unsigned n;
+    if (name[0] == '/') name++;
+    if (sscanf(name, "log%5u.", &n) == 1 && n >= next) next = n + 1; // plain and packed logs share the numbers
+  }
+  return next;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file sd_logger.h
+ *
+ * @brief writes the captured lines to the sd card slot of the tft module. Like the mqtt batches a cursor walks
+ * the history, lines are formatted with their receive stamp into one of two SD_BLOCK_SIZE buffers while a
+ * writer task puts the other one on the card. Blocks are always written whole at block aligned file offsets, a
+ * partly filled block is synced every SD_SYNC_MS and rewritten in place once it is full - after a power loss the
+ * file holds everything up to the last sync. Files rotate by size or age: /log00000.txt, /log00001.txt ...
+ *
+ * With SD_COMPRESS the writer task packs every block (see block_codec.h) before it goes on the card, the files
+ * are /logNNNNN.lzb then: a sequence of frames, each a SD_FRAME_HEADER byte header ("LB", raw size, packed size,
+ * little endian, packed size == raw size: stored as is) and the LZ4 block data. Frames decode independently, a
+ * reader can seek from header to header to any part of a file. Frames are only ever appended: the sync of a
+ * partly filled block closes it as a shorter frame - rewriting it in place could leave the tail of a longer
+ * earlier packing behind. tools/unpack_log.py turns a file back into text.
+ *
+ * Nothing here blocks the main loop: while both buffers are busy the lines simply wait in the history.
+ */
+
+#ifndef SD_LOGGER_H
+#define SD_LOGGER_H
+
+#include <Arduino.h>
+#include <SD.h>
+#include <atomic>
+#include "block_codec.h"
+#include "history.h"
+#include "line_assembler.h"
+#include "line_clock.h"
+#include "spi_bus.h"
+
+#ifndef SD_BLOCK_SIZE
+#define SD_BLOCK_SIZE 8192 // multiple of the 512 byte sector, 4k .. 16k
+#endif
+#define SD_SLICE 2048                      // bytes written per bus lock, bounds the display latency
+#define SD_SYNC_MS 2000                    // how often a partly filled block goes to the card
+#ifndef SD_COMPRESS
+#define SD_COMPRESS 1 // 0 = plain text files
+#endif
+#define SD_FRAME_HEADER 6
+#define SD_FILE_BYTES (16UL * 1024 * 1024) // rotate by size (of the text) ...
+#define SD_FILE_MS (60UL * 60 * 1000)      // ... or age
+#define SD_SPI_FREQUENCY 20000000
+#define SD_TASK_STACK 4096
+#define SD_TASK_PRIORITY 2 // below the ingest task on the same core
+#define SD_TASK_CORE 0
+
+class SdLogger {
+public:
+  SdLogger();
+
+  // mounts the card, false if there is none (the logger then stays idle)
+  bool begin(uint8_t csPin, LineHistory *lines, const LineClock *clock);
+
+  // call once per loop pass, outside of the display's bus lock
+  void handle();
+
+  bool ready() const { return mounted; }
+  uint16_t fileIndex() const { return index; } // number of the current log file
+  uint32_t written() const { return bytes; }  // bytes put on the card, packed with SD_COMPRESS
+  uint32_t skipped() const { return gaps; }   // lines evicted from the history before they were logged
+  uint32_t errors() const { return failures; } // a write error stops the logger
+  uint32_t backlog() const { return history ? history->end() - cursor : 0; } // lines not yet staged
+
+private:
+  struct Job {
+    const uint8_t *data;
+    size_t len;
+    uint32_t offset; // file position of the block
+    bool full;       // the block is done with, the next one follows it in the file
+    bool rotate;     // close the file afterwards and start the next one
+  };
+
+  static void taskEntry(void *arg);
+  void run();
+  void writeJob();
+  size_t packFrame();
+  bool openNext();
+  uint16_t findNextIndex();
+  bool submit(size_t len, bool full, bool rotate);
+  bool stageLine();
+
+  uint8_t cs;
+  LineHistory *history;
+  const LineClock *timeBase;
+  TaskHandle_t task;
+  File file;
+  volatile bool mounted;
+  uint16_t index;
+  uint16_t nextFile;
+
+  // main loop side
+  uint8_t *block[2];
+  uint8_t fill;          // buffer being filled
+  size_t used;           // bytes in it
+  size_t synced;         // bytes of it already on the card
+  uint32_t blockStart;   // its file offset
+  uint32_t cursor;       // next history line
+  uint32_t lastSync;     // millis() of the last block handed to the writer
+  uint32_t fileStart;    // millis() when the current file was started
+  char stage[32 + LINE_MAX_TEXT];
+  size_t stageLen;
+  size_t stageOff;
+
+  // handed over to the writer task
+  Job job;
+  std::atomic<bool> busy;
+
+  // writer task side
+  BlockCodec codec;
+  uint8_t *frame;      // header and packed block
+  uint32_t frameStart; // file position of the frame being written
+
+  volatile uint32_t bytes;
+  volatile uint32_t failures;
+  uint32_t gaps;
+};
+
+#endif
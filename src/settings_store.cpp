@@ -0,0 +1,59 @@
+/**
+ * @file settings_store.cpp
+ *
+ * @brief nvs blob of the boot settings, see settings_store.h
+ */
+
+#include <stddef.h>
+#include "settings_store.h"
+
+#define SETTINGS_MAGIC 0x4d53 // "SM"
+
+SettingsStore::SettingsStore() : valid(false) {
+  memset(&stored, 0, sizeof(stored));
+}
+
+size_t SettingsStore::used(const StoredSettings &s) {
+  return offsetof(StoredSettings, filter) + strnlen(s.filter, sizeof(s.filter) - 1) + 1;
+}
+
+bool SettingsStore::load(StoredSettings *s) {
+  nvs_handle_t h;
+  StoredSettings blob;
+  size_t len = sizeof(blob);
+
+  if (nvs_open(SETTINGS_NAMESPACE, NVS_READONLY, &h) != ESP_OK) return false; // nothing saved yet
+  esp_err_t err = nvs_get_blob(h, SETTINGS_KEY, &blob, &len);
+  nvs_close(h);
+
+  if (err != ESP_OK || len <= offsetof(StoredSettings, filter)) return false;
+  if (blob.magic != SETTINGS_MAGIC || blob.version != SETTINGS_VERSION) return false;
+  blob.filter[len - offsetof(StoredSettings, filter) - 1] = 0;
+
+  memcpy(s, &blob, sizeof(blob));
+  stored = blob;
+  valid = true;
+  return true;
+}
+
+bool SettingsStore::save(const StoredSettings &s) {
+  StoredSettings blob = s;
+  blob.magic = SETTINGS_MAGIC;
+  blob.version = SETTINGS_VERSION;
+  blob.reserved = 0;
+  blob.filter[sizeof(blob.filter) - 1] = 0;
+  size_t len = used(blob);
+
+  if (valid && len == used(stored) && memcmp(&blob, &stored, len) == 0) return true; // unchanged
+
+  nvs_handle_t h;
+  if (nvs_open(SETTINGS_NAMESPACE, NVS_READWRITE, &h) != ESP_OK) return false;
+  esp_err_t err = nvs_set_blob(h, SETTINGS_KEY, &blob, len);
+  if (err == ESP_OK) err = nvs_commit(h);
+  nvs_close(h);
+  if (err != ESP_OK) return false;
+
+  stored = blob;
+  valid = true;
+  return true;
+}
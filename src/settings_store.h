@@ -0,0 +1,51 @@
+/**
+ * @file settings_store.h
+ *
+ * @brief the settings which decide how the monitor starts - capture baud rates, font, orientation, stamps, screen
+ * filter and the touch calibration - kept in a single nvs blob. Loading it is one flash read of a few hundred
+ * bytes with nothing to parse, so the uarts are set up with the right rates before anything else happens at boot.
+ * save() only writes when something changed, the filter spec is stored without its unused tail.
+ */
+
+#ifndef SETTINGS_STORE_H
+#define SETTINGS_STORE_H
+
+#include <Arduino.h>
+#include <nvs.h>
+#include "line_filter.h"
+
+#define SETTINGS_NAMESPACE "monitor"
+#define SETTINGS_KEY "boot"
+#define SETTINGS_VERSION 1 // bump when StoredSettings changes, older blobs are then ignored
+
+struct StoredSettings {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t font;           // 1..4
+  uint32_t baud[2];       // capture channels
+  uint8_t orientation;    // 0 portrait, 1 landscape
+  uint8_t stamps;         // receive time in front of the lines on screen
+  uint8_t touchValid;     // touchCal holds a calibration
+  uint8_t reserved;
+  uint16_t touchCal[5];   // as used by TFT_eSPI::setTouch()
+  char filter[FILTER_SPEC_MAX]; // line_filter.h rule spec, stored up to its terminating zero
+};
+
+class SettingsStore {
+public:
+  SettingsStore();
+
+  // fill s from the blob, false if there is none (or an outdated one) - s is left as it was then
+  bool load(StoredSettings *s);
+
+  // write s unless it matches what is stored
+  bool save(const StoredSettings &s);
+
+private:
+  static size_t used(const StoredSettings &s);
+
+  StoredSettings stored; // last loaded or saved
+  bool valid;
+};
+
+#endif
@@ -0,0 +1,28 @@
+/**
+ * @file spi_bus.h
+ *
+ * @brief tft, touch controller and sd card share one spi bus. Whoever talks to one of them holds this lock:
+ * the main loop for its display pass, the sd writer task for one slice of a block at a time - so neither can
+ * keep the other off the bus for long. The uart ingest task never touches spi and is not affected.
+ */
+
+#ifndef SPI_BUS_H
+#define SPI_BUS_H
+
+#include <Arduino.h>
+
+class SpiBus {
+public:
+  SpiBus() : mutex(nullptr) {}
+
+  void begin() { mutex = xSemaphoreCreateMutex(); } // a mutex, the holder inherits the priority of a waiter
+  void lock() { xSemaphoreTake(mutex, portMAX_DELAY); }
+  void unlock() { xSemaphoreGive(mutex); }
+
+private:
+  SemaphoreHandle_t mutex;
+};
+
+extern SpiBus spiBus;
+
+#endif
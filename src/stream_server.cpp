@@ -0,0 +1,291 @@
+/**
+ * @file stream_server.cpp
+ *
+ * @brief tcp fan-out from a shared ring, see stream_server.h
+ */
+
+#include <lwip/sockets.h>
+#include "stream_server.h"
+
+#define REPLAY_CHUNK_LINES 64
+
+// replayed lines: stamp, text with its colours as SGR sequences (at most one per glyph), reset and CRLF. A chunk
+// is filled while it is shorter than STREAM_CHUNK, so the last line may go past it
+static char stage[STREAM_CHUNK + 32 + 3 * LINE_MAX_TEXT];
+static uint16_t stageEnd[REPLAY_CHUNK_LINES];  // end of every line in the chunk ...
+static uint32_t stageNext[REPLAY_CHUNK_LINES]; // ... and the history line after it
+
+StreamServer::StreamServer(uint16_t port, size_t bytes, uint32_t ms)
+  : server(port), welcomeMsg(nullptr), input(nullptr), flushBytes(bytes), flushMs(ms), lineStart(0), lost(0),
+    shedCount(0), history(nullptr), stampClock(nullptr), replayChannel(0) {
+  ring.begin(storage, STREAM_RING_SIZE);
+  for (uint8_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    client[i].cursor = 0;
+    client[i].pendingSince = 0;
+    client[i].skips = 0;
+    client[i].noteLen = client[i].noteOff = 0;
+    client[i].replay = 0;
+    client[i].replayOff = 0;
+    client[i].stampOffset = 0;
+    client[i].replaying = false;
+    client[i].active = false;
+  }
+}
+
+void StreamServer::begin(const char *welcome) {
+  welcomeMsg = welcome;
+  server.begin();
+  server.setNoDelay(true); // batching is done here, nagle would only add latency
+}
+
+void StreamServer::setFlush(size_t bytes, uint32_t ms) {
+  flushBytes = bytes;
+  flushMs = ms;
+}
+
+void StreamServer::setReplay(const LineHistory *lines, uint8_t channel, const LineClock *clock) {
+  history = lines;
+  replayChannel = channel;
+  stampClock = clock;
+}
+
+void StreamServer::write(const uint8_t *data, size_t len) {
+  if (len == 0) return;
+
+  uint32_t at = ring.writePos();
+  ring.write(data, len); // the only copy, whoever is connected
+  for (size_t i = len; i > 0; i--) {
+    if (data[i - 1] == '\r' || data[i - 1] == '\n') {
+      lineStart = at + i;
+      break;
+    }
+  }
+
+  for (uint8_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    Client &c = client[i];
+    if (!c.active) continue;
+
+    if (c.replaying) continue; // handle() switches it to live once the history is sent
+
+    if (c.cursor == at) c.pendingSince = millis();
+    size_t pending = ring.writePos() - c.cursor;
+    if (pending > STREAM_HIGH_WATER) skipAhead(c);
+    else if (flushMs == 0 || pending >= flushBytes) flush(c, true);
+  }
+}
+
+void StreamServer::handle() {
+  accept();
+  for (uint8_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    Client &c = client[i];
+    if (!c.active) continue;
+
+    if (!c.sock.connected()) {
+      close(c);
+      continue;
+    }
+
+    uint8_t buf[128];
+    while (c.sock.available()) {
+      int n = c.sock.read(buf, sizeof(buf));
+      if (n <= 0) break;
+      if (input) input(buf, n);
+    }
+    if (c.replaying) {
+      if (!replay(c)) continue;
+      // caught up: live from the start of the line in progress, which the history does not have yet
+      c.replaying = false;
+      c.cursor = ring.writePos() - lineStart <= STREAM_LINE_BACK ? lineStart : ring.writePos();
+      c.pendingSince = millis();
+    }
+    flush(c, false);
+  }
+}
+
+uint8_t StreamServer::clients() const {
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < STREAM_MAX_CLIENTS; i++) n += client[i].active;
+  return n;
+}
+
+size_t StreamServer::backlog() const {
+  size_t most = 0;
+  for (uint8_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    const Client &c = client[i];
+    if (c.active && !c.replaying && ring.writePos() - c.cursor > most) most = ring.writePos() - c.cursor;
+  }
+  return most;
+}
+
+void StreamServer::accept() {
+  if (!server.hasClient()) return;
+
+  WiFiClient incoming = server.available();
+  for (uint8_t i = 0; i < STREAM_MAX_CLIENTS; i++) {
+    Client &c = client[i];
+    if (c.active) continue;
+
+    c.sock = incoming;
+    c.sock.setNoDelay(true);
+    c.cursor = ring.writePos(); // nothing of what was sent before
+    c.skips = 0;
+    c.noteLen = c.noteOff = 0;
+    c.active = true;
+    if (welcomeMsg) c.sock.write((const uint8_t *)welcomeMsg, strlen(welcomeMsg));
+    c.replaying = history != nullptr;
+    if (c.replaying) {
+      c.replay = replayStart();
+      c.replayOff = 0;
+      c.stampOffset = stampClock ? stampClock->epochOffset() : 0;
+    }
+    return;
+  }
+  incoming.stop(); // all slots taken
+}
+
+// the client fell too far behind: drop its backlog and tell it so, or disconnect it if this keeps happening
+void StreamServer::skipAhead(Client &c) {
+  uint32_t skipped = ring.writePos() - c.cursor;
+
+  if (c.skips == 0 || millis() - c.skipSince >= STREAM_SKIP_WINDOW_MS) {
+    c.skips = 0;
+    c.skipSince = millis();
+  }
+  lost += skipped;
+  if (++c.skips >= STREAM_MAX_SKIPS) {
+    shedCount++;
+    close(c);
+    return;
+  }
+
+  c.cursor = ring.writePos();
+  c.noteLen = snprintf(c.note, sizeof(c.note), "\r\n[... %u bytes skipped]\r\n", (unsigned)skipped);
+  c.noteOff = 0;
+}
+
+// the oldest of the last STREAM_REPLAY_LINES lines of the channel which fit into STREAM_REPLAY_BYTES
+uint32_t StreamServer::replayStart() const {
+  uint32_t seq = history->end();
+  uint32_t lines = 0;
+  size_t bytes = 0;
+
+  while (seq != history->first() && lines < STREAM_REPLAY_LINES) {
+    const char *text;
+    size_t len;
+    uint8_t ch;
+    if (!history->get(seq - 1, &text, &len, nullptr, &ch)) break;
+    if (ch == replayChannel) {
+      if (bytes + len > STREAM_REPLAY_BYTES) break;
+      bytes += len;
+      lines++;
+    }
+    seq--;
+  }
+  return seq;
+}
+
+// send history lines while the socket takes them, true once the client has all of them. A chunk of lines is
+// formatted from c.replay on, the part of it the socket took is skipped with replayOff next time. That only works
+// because the chunk comes out the same on every pass: same lines, same anchor for the stamps
+bool StreamServer::replay(Client &c) {
+  if ((int32_t)(history->first() - c.replay) > 0) { // evicted meanwhile
+    c.replay = history->first();
+    c.replayOff = 0;
+  }
+
+  for (;;) {
+    size_t n = 0;
+    uint8_t lines = 0;
+    uint32_t seq = c.replay;
+    while (seq != history->end() && n < STREAM_CHUNK && lines < REPLAY_CHUNK_LINES) {
+      const char *text;
+      size_t len;
+      int64_t stamp;
+      uint8_t ch;
+      bool ok = history->get(seq, &text, &len, &stamp, &ch);
+      seq++;
+      if (!ok || ch != replayChannel) continue;
+      n += formatLine(text, len, stamp, c.stampOffset, stage + n);
+      stageEnd[lines] = n;
+      stageNext[lines++] = seq;
+    }
+    if (lines == 0) {
+      c.replay = seq;
+      return true;
+    }
+
+    int sent = sendNow(c, (const uint8_t *)stage + c.replayOff, n - c.replayOff);
+    if (sent < 0) return false;
+    size_t done = c.replayOff + sent;
+    uint8_t full = 0;
+    while (full < lines && stageEnd[full] <= done) full++;
+    if (full > 0) {
+      c.replay = stageNext[full - 1];
+      c.replayOff = done - stageEnd[full - 1];
+    } else {
+      c.replayOff = done;
+    }
+    if (done < n) return false; // socket buffer full, the rest follows on the next pass
+  }
+}
+
+size_t StreamServer::formatLine(const char *text, size_t len, int64_t stamp, int64_t anchor, char *out) const {
+  size_t n = 0;
+
+  if (stampClock) {
+    n = stampClock->format(stamp, out, 23, 6, anchor); // same width as the live stamps
+    out[n++] = ' ';
+  }
+  uint8_t colour = 0;
+  for (size_t i = 0; i < len && i < LINE_MAX_TEXT; i++) {
+    uint8_t b = text[i];
+    if (b >= LINE_FIRST_CHAR) {
+      out[n++] = b;
+    } else {
+      colour = b - LINE_COLOUR_MARKER;
+      n += AnsiDecoder::sgr(colour, out + n);
+    }
+  }
+  if (colour) n += AnsiDecoder::sgr(0, out + n);
+  out[n++] = '\r';
+  out[n++] = '\n';
+  return n;
+}
+
+// send the gap marker and as much of the client's part of the ring as the socket takes, without waiting
+void StreamServer::flush(Client &c, bool force) {
+  size_t pending = ring.writePos() - c.cursor;
+  if (pending == 0 && c.noteOff == c.noteLen) return;
+  if (!force && pending < flushBytes && millis() - c.pendingSince < flushMs) return;
+
+  if (c.noteOff < c.noteLen) {
+    int sent = sendNow(c, (const uint8_t *)c.note + c.noteOff, c.noteLen - c.noteOff);
+    if (sent <= 0) return;
+    c.noteOff += sent;
+    if (c.noteOff < c.noteLen) return;
+  }
+
+  const uint8_t *data;
+  size_t len;
+  while ((len = ring.peek(c.cursor, &data)) > 0) {
+    int sent = sendNow(c, data, len);
+    if (sent <= 0) return;
+    c.cursor += sent;
+    if ((size_t)sent < len) return; // socket buffer full, retry on the next pass
+  }
+}
+
+// non-blocking write, returns the bytes taken by the socket or -1 if the connection was closed
+int StreamServer::sendNow(Client &c, const uint8_t *data, size_t len) {
+  int sent = send(c.sock.fd(), data, len, MSG_DONTWAIT);
+  if (sent >= 0) return sent;
+  if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+  close(c);
+  return -1;
+}
+
+void StreamServer::close(Client &c) {
+  c.sock.stop();
+  c.replaying = false;
+  c.active = false;
+}
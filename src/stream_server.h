@@ -0,0 +1,113 @@
+/**
+ * @file stream_server.h
+ *
+ * @brief tcp server which fans a byte stream out to several clients, used for the telnet text port and the raw
+ * serial bridge. Data is copied once into a shared BroadcastRing, every client only has a cursor into it and is
+ * sent its part with non-blocking socket writes once flushBytes are pending or the oldest byte is flushMs old
+ * (flushMs == 0 sends right away).
+ * Nothing waits for a slow client: one whose backlog passes STREAM_HIGH_WATER skips ahead to the newest data
+ * and gets a "[... n bytes skipped]" line instead, one which keeps falling behind is disconnected. The other
+ * clients and the capture path never notice.
+ *
+ * With setReplay() a new client first gets the last lines of its channel from the history. Its own cursor walks
+ * the history as fast as its socket takes the text, in chunks of several lines - a few clients catching up at
+ * once do not hold up the capture - and once the cursor has reached the end of the history the client goes live
+ * at the start of the line in progress, which is not in the history yet. If that start is too far back (a binary
+ * stream may have no line breaks at all) it goes live at the current ring position instead.
+ * The stamps of a replay are all formatted with the clock anchor of its start, sntp setting the time meanwhile
+ * does not change the text of a chunk which is already partly sent.
+ */
+
+#ifndef STREAM_SERVER_H
+#define STREAM_SERVER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "history.h"
+#include "line_assembler.h"
+#include "line_clock.h"
+#include "ring_buffer.h"
+
+#define STREAM_MAX_CLIENTS 4
+#define STREAM_RING_SIZE 8192                        // shared by the clients of a server, power of two
+#define STREAM_HIGH_WATER (STREAM_RING_SIZE * 3 / 4) // backlog of a client which makes it skip ahead
+#define STREAM_MAX_SKIPS 3                           // skips within STREAM_SKIP_WINDOW_MS disconnect a client
+#define STREAM_SKIP_WINDOW_MS 10000
+#define STREAM_CHUNK 1460                            // one tcp segment of replayed lines
+#define STREAM_REPLAY_LINES 200         // history sent to a new client: at most this many lines ...
+#define STREAM_REPLAY_BYTES (16 * 1024) // ... and bytes of text
+#define STREAM_LINE_BACK 2048           // line in progress a client going live gets, at most
+
+// data received from a client
+typedef void (*StreamInput)(const uint8_t *data, size_t len);
+
+class StreamServer {
+public:
+  StreamServer(uint16_t port, size_t flushBytes, uint32_t flushMs);
+
+  void begin(const char *welcome = nullptr);
+
+  // handler for data from the clients, nullptr discards it
+  void onInput(StreamInput handler) { input = handler; }
+
+  // batching thresholds, flushMs == 0 sends right away
+  void setFlush(size_t bytes, uint32_t ms);
+
+  // catch up new clients with the history lines of channel, stamped like the live text if clock is given
+  void setReplay(const LineHistory *lines, uint8_t channel, const LineClock *clock);
+
+  // send data to every connected client
+  void write(const uint8_t *data, size_t len);
+  void write(const char *text) { write((const uint8_t *)text, strlen(text)); }
+
+  // accept new clients, read input, send due data, drop closed connections - call once per loop pass
+  void handle();
+
+  uint8_t clients() const;
+  uint32_t dropped() const { return lost; }  // bytes skipped by clients which fell behind
+  uint32_t shed() const { return shedCount; } // clients disconnected for being too slow
+  size_t backlog() const;                     // bytes pending for the slowest client
+
+private:
+  struct Client {
+    WiFiClient sock;
+    uint32_t cursor;       // ring position of the next byte to send
+    uint32_t pendingSince; // millis() of the oldest unsent byte
+    uint32_t skipSince;    // millis() of the first skip in the current window
+    uint8_t skips;
+    char note[40];         // gap marker, sent before the ring data
+    uint8_t noteLen;
+    uint8_t noteOff;
+    uint32_t replay;       // next history line to send
+    uint16_t replayOff;    // bytes of it already sent
+    int64_t stampOffset;   // clock anchor the replayed lines are stamped with
+    bool replaying;        // live data is held back until the history is sent
+    bool active;
+  };
+
+  void accept();
+  void skipAhead(Client &c);
+  void flush(Client &c, bool force);
+  uint32_t replayStart() const;
+  bool replay(Client &c);
+  size_t formatLine(const char *text, size_t len, int64_t stamp, int64_t anchor, char *out) const;
+  int sendNow(Client &c, const uint8_t *data, size_t len);
+  void close(Client &c);
+
+  WiFiServer server;
+  const char *welcomeMsg;
+  StreamInput input;
+  size_t flushBytes;
+  uint32_t flushMs;
+  BroadcastRing ring;
+  uint8_t storage[STREAM_RING_SIZE];
+  Client client[STREAM_MAX_CLIENTS];
+  uint32_t lineStart; // ring position after the last CR or LF, where a client going live starts
+  uint32_t lost;
+  uint32_t shedCount;
+  const LineHistory *history; // replay source, nullptr = live data only
+  const LineClock *stampClock;
+  uint8_t replayChannel;
+};
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * @file text_layout.cpp
+ *
+ * @brief row breaking and layout cache, see text_layout.h
+ */
+
+#include "text_layout.h"
+
+// all line fonts are monospaced, the tables still hold one advance per glyph so proportional fonts fit in
+#define ADVANCE_16(a) a, a, a, a, a, a, a, a, a, a, a, a, a, a, a, a
+#define ADVANCE_ALL(a) ADVANCE_16(a), ADVANCE_16(a), ADVANCE_16(a), ADVANCE_16(a), ADVANCE_16(a), ADVANCE_16(a)
+
+static constexpr uint8_t advanceTable[LAYOUT_FONTS][LINE_GLYPHS] = {
+  {ADVANCE_ALL(6)},  // glcd font 1
+  {ADVANCE_ALL(11)}, // FreeMono9pt7b xAdvance
+  {ADVANCE_ALL(14)}, // FreeMono12pt7b
+  {ADVANCE_ALL(28)}, // FreeMono24pt7b
+};
+
+static_assert(sizeof(advanceTable[0]) == LINE_GLYPHS, "one advance per printable glyph");
+
+#undef ADVANCE_ALL
+#undef ADVANCE_16
+
+const uint8_t *layoutAdvances(LayoutFont font) {
+  return advanceTable[font < LAYOUT_FONTS ? font : LAYOUT_GLCD];
+}
+
+size_t layoutRow(const char *text, size_t len, const uint8_t *advances, uint16_t width) {
+  uint16_t px = 0;
+  bool marker = false;
+
+  for (size_t i = 0; i < len; i++) {
+    uint8_t c = text[i];
+    if (c < LINE_FIRST_CHAR) { // colour marker, it moves on to the next row with its glyph
+      marker = true;
+      continue;
+    }
+    if (px > width || i >= LINE_MAX_CHARS - 1) return c == ' ' ? i + 1 : layoutBreak(text, marker ? i - 1 : i, c);
+    px += advances ? advances[c - LINE_FIRST_CHAR] : 6;
+    marker = false;
+  }
+  return len;
+}
+
+size_t layoutBreak(const char *row, size_t overflow, uint8_t next) {
+  if (next == ' ') return overflow + 1;
+  for (size_t j = overflow; j-- > 1;) {
+    if (row[j] == ' ') return j + 1;
+  }
+  return overflow > 0 ? overflow : 1;
+}
+
+uint8_t layoutColour(const char *text, size_t pos) {
+  for (size_t i = pos; i-- > 0;) {
+    uint8_t c = text[i];
+    if (c < LINE_FIRST_CHAR) return c - LINE_COLOUR_MARKER;
+  }
+  return 0;
+}
+
+LayoutCache::LayoutCache() : adv(nullptr), width(310), generation(1) {
+  for (uint16_t i = 0; i < LAYOUT_CACHE_LINES; i++) slot[i].generation = 0;
+}
+
+void LayoutCache::begin(const uint8_t *advances, uint16_t px) {
+  adv = advances;
+  width = px;
+  if (++generation == 0) { // wrapped, old entries could look current again
+    for (uint16_t i = 0; i < LAYOUT_CACHE_LINES; i++) slot[i].generation = 0;
+    generation = 1;
+  }
+}
+
+bool LayoutCache::cached(uint32_t seq) const {
+  const LineLayout &l = slot[seq & (LAYOUT_CACHE_LINES - 1)];
+  return l.generation == generation && l.seq == seq;
+}
+
+const LineLayout &LayoutCache::get(uint32_t seq, const char *text, size_t len) {
+  LineLayout &l = slot[seq & (LAYOUT_CACHE_LINES - 1)];
+  if (l.generation == generation && l.seq == seq) return l;
+
+  size_t pos = 0;
+  l.rows = 0;
+  do {
+    l.start[l.rows++] = pos;
+    pos += layoutRow(text + pos, len - pos, adv, width);
+  } while (pos < len && l.rows < LAYOUT_MAX_ROWS);
+  l.stop = pos;
+  l.seq = seq;
+  l.generation = generation;
+  return l;
+}
@@ -0,0 +1,71 @@
+/**
+ * @file text_layout.h
+ *
+ * @brief how a received line is broken into screen rows. Glyph advances of the line fonts come from constexpr
+ * tables instead of being measured on the display, rows are broken after the last space that fits (a word longer
+ * than a row is split). The LineAssembler applies the same rule while a line comes in, the LayoutCache keeps the
+ * row starts of history lines, so redrawing scrollback after a font or orientation change only measures lines
+ * that were not laid out for the new width yet - the visible ones first, the rest a few per loop pass.
+ * Pure c++ without arduino dependencies.
+ */
+
+#ifndef TEXT_LAYOUT_H
+#define TEXT_LAYOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "line_assembler.h"
+
+#define LAYOUT_CACHE_LINES 128 // power of two, more than two screens of history
+#define LAYOUT_MAX_ROWS 16     // screen rows of one line, the rest of a longer line is not shown on redraw
+
+// the fonts of the config menu: glcd font 1, FreeMono 9, 12 and 24 pt
+enum LayoutFont : uint8_t { LAYOUT_GLCD, LAYOUT_MONO9, LAYOUT_MONO12, LAYOUT_MONO24, LAYOUT_FONTS };
+
+// pixel advance of the LINE_GLYPHS printable characters
+const uint8_t *layoutAdvances(LayoutFont font);
+
+// length of the row at the start of text: glyphs are added while the row is not wider than width (like the old
+// render loop), then it is broken with layoutBreak(). colour markers take no space
+size_t layoutRow(const char *text, size_t len, const uint8_t *advances, uint16_t width);
+
+// length of a row which overflows at index overflow with glyph next: a space there stays at the end of the
+// row, otherwise the row ends after its last space - a row without one is split at overflow
+size_t layoutBreak(const char *row, size_t overflow, uint8_t next);
+
+// colour index in effect at offset pos of a line, from the last colour marker before it
+uint8_t layoutColour(const char *text, size_t pos);
+
+struct LineLayout {
+  uint32_t seq;
+  uint16_t generation;             // layout it was made for, 0 = unused
+  uint8_t rows;
+  uint16_t start[LAYOUT_MAX_ROWS]; // offset of every row in the line text
+  uint16_t stop;                   // end of the last row
+
+  // row r is text[begin(r), finish(r))
+  uint16_t begin(uint8_t r) const { return start[r]; }
+  uint16_t finish(uint8_t r) const { return r + 1 < rows ? start[r + 1] : stop; }
+};
+
+class LayoutCache {
+public:
+  LayoutCache();
+
+  // font or row width changed, every cached layout is stale
+  void begin(const uint8_t *advances, uint16_t width);
+
+  // rows of history line seq, laid out now unless cached
+  const LineLayout &get(uint32_t seq, const char *text, size_t len);
+
+  // the layout of seq for the current font and width is at hand
+  bool cached(uint32_t seq) const;
+
+private:
+  LineLayout slot[LAYOUT_CACHE_LINES];
+  const uint8_t *adv;
+  uint16_t width;
+  uint16_t generation;
+};
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * @file text_rows.cpp
+ *
+ * @brief screen text model, see text_rows.h
+ */
+
+#include <string.h>
+#include "text_rows.h"
+
+TextRows::TextRows() : first(0), count(1), total(1), scrolls(0) {
+  len[0] = 0;
+  ink[0] = ROW_DEFAULT_COLOUR;
+  shown[0] = hash("", 0, ROW_DEFAULT_COLOUR);
+}
+
+void TextRows::begin(uint8_t rows) {
+  if (rows < 1) rows = 1;
+  if (rows > SCREEN_MAX_ROWS) rows = SCREEN_MAX_ROWS;
+  total = rows;
+  first = 0;
+  count = 1;
+  scrolls = 0;
+  memset(len, 0, sizeof(len));
+  invalidate();
+}
+
+void TextRows::commit(const char *text, size_t n, uint16_t colour) {
+  setOpen(text, n, colour);
+
+  if (count < total) {
+    count++;
+  } else {
+    first = (first + 1) % total;
+  }
+  len[slot(count - 1)] = 0;
+  scrolls++;
+}
+
+void TextRows::setOpen(const char *text, size_t n, uint16_t colour) {
+  if (n > LINE_MAX_CHARS) n = LINE_MAX_CHARS;
+  uint8_t s = slot(count - 1);
+  memcpy(cell[s], text, n);
+  len[s] = n;
+  ink[s] = colour;
+}
+
+size_t TextRows::row(uint8_t i, const char **text) const {
+  if (i >= count) {
+    *text = "";
+    return 0;
+  }
+  uint8_t s = slot(i);
+  *text = cell[s];
+  return len[s];
+}
+
+uint16_t TextRows::colour(uint8_t i) const {
+  return i < count ? ink[slot(i)] : ROW_DEFAULT_COLOUR;
+}
+
+bool TextRows::changed(uint8_t i) const {
+  const char *text;
+  size_t n = row(i, &text);
+  return hash(text, n, colour(i)) != shown[i];
+}
+
+void TextRows::markDrawn(uint8_t i) {
+  const char *text;
+  size_t n = row(i, &text);
+  shown[i] = hash(text, n, colour(i));
+}
+
+void TextRows::invalidate() {
+  uint32_t empty = hash("", 0, ROW_DEFAULT_COLOUR);
+  for (uint8_t i = 0; i < SCREEN_MAX_ROWS; i++) shown[i] = empty;
+}
+
+// fnv-1a over colour and text, good enough to detect a changed row
+uint32_t TextRows::hash(const char *text, size_t n, uint16_t colour) {
+  uint32_t h = (2166136261u ^ colour) * 16777619u;
+  for (size_t i = 0; i < n; i++) {
+    h ^= (uint8_t)text[i];
+    h *= 16777619u;
+  }
+  return h ^ n;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file text_rows.h
+ *
+ * @brief text cell model of the visible screen: a ring with one entry per text row, the open (incomplete) line
+ * at the bottom. Keeping characters instead of pixels costs a few kb where a 480x320 frame buffer would not fit.
+ * For every row the hash of what is currently on the display is kept, so a redraw only touches changed rows.
+ * Pure c++ without arduino dependencies.
+ */
+
+#ifndef TEXT_ROWS_H
+#define TEXT_ROWS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "line_assembler.h"
+
+#define SCREEN_MAX_ROWS 64 // 480 pixels / 9 pixel glcd rows = 53 in portrait
+#define ROW_DEFAULT_COLOUR 0xFFFF // rgb565 white
+
+class TextRows {
+public:
+  TextRows();
+
+  // visible rows, clears the model - the display is expected to be blank as well
+  void begin(uint8_t rows);
+
+  // a finished line replaces the open row, a new empty open row follows (the top row scrolls out once full)
+  void commit(const char *text, size_t len, uint16_t colour = ROW_DEFAULT_COLOUR);
+
+  // text of the incomplete bottom line
+  void setOpen(const char *text, size_t len, uint16_t colour = ROW_DEFAULT_COLOUR);
+
+  uint8_t rows() const { return total; }
+  uint8_t openRow() const { return count - 1; }
+
+  // text of screen row i, counted from the top
+  size_t row(uint8_t i, const char **text) const;
+  uint16_t colour(uint8_t i) const;
+
+  // row i differs from what was last drawn there
+  bool changed(uint8_t i) const;
+  void markDrawn(uint8_t i);
+
+  // the display has been cleared, e.g. by fillScreen()
+  void invalidate();
+
+  // lines committed since the last redraw - bursts of new lines move every row and are coalesced into one redraw
+  uint16_t scrolled() const { return scrolls; }
+  void clearScrolled() { scrolls = 0; }
+
+private:
+  static uint32_t hash(const char *text, size_t len, uint16_t colour);
+  uint8_t slot(uint8_t i) const { return (first + i) % total; }
+
+  char cell[SCREEN_MAX_ROWS][LINE_MAX_CHARS];
+  uint8_t len[SCREEN_MAX_ROWS];
+  uint16_t ink[SCREEN_MAX_ROWS];   // text colour of the row, e.g. per capture channel
+  uint32_t shown[SCREEN_MAX_ROWS]; // hash of the row content on the display, per screen row
+  uint8_t first;                   // slot of the top screen row
+  uint8_t count;                   // rows in use, including the open row
+  uint8_t total;
+  uint16_t scrolls;
+};
+
+#endif
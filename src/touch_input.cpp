@@ -0,0 +1,80 @@
+/**
+ * @file touch_input.cpp
+ *
+ * @brief touch sampling task, see touch_input.h
+ */
+
+#include "touch_input.h"
+
+TouchInput::TouchInput(TFT_eSPI *display) : tft(display), events(nullptr), task(nullptr), irq(-1) {}
+
+bool TouchInput::begin(int8_t irqPin) {
+  irq = irqPin;
+  events = xQueueCreate(TOUCH_QUEUE, sizeof(TouchEvent));
+  if (events == nullptr) return false;
+
+  if (xTaskCreatePinnedToCore(taskEntry, "touch", TOUCH_TASK_STACK, this,
+                              TOUCH_TASK_PRIORITY, &task, TOUCH_TASK_CORE) != pdPASS) return false;
+  if (irq >= 0) {
+    pinMode(irq, INPUT_PULLUP);
+    attachInterruptArg(irq, onPen, this, FALLING);
+  }
+  return true;
+}
+
+bool TouchInput::read(TouchEvent *event) {
+  return events && xQueueReceive(events, event, 0) == pdTRUE;
+}
+
+void TouchInput::clear() {
+  if (events) xQueueReset(events);
+}
+
+void TouchInput::taskEntry(void *arg) {
+  static_cast<TouchInput *>(arg)->run();
+}
+
+// pen down - wakes the task, which then samples at the normal rate until the finger is lifted
+void IRAM_ATTR TouchInput::onPen(void *arg) {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(static_cast<TouchInput *>(arg)->task, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+void TouchInput::run() {
+  bool touching = false;
+  uint16_t lastX = 0, lastY = 0;
+  TickType_t wake = xTaskGetTickCount();
+
+  for (;;) {
+    if (!touching && irq >= 0 && digitalRead(irq) == HIGH) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      wake = xTaskGetTickCount();
+    }
+
+    uint16_t x, y;
+    spiBus.lock();
+    bool pressed = tft->getTouch(&x, &y);
+    spiBus.unlock();
+
+    if (pressed) {
+      if (!touching) post(TouchEvent::DOWN, x, y);
+      else if (x != lastX || y != lastY) post(TouchEvent::MOVE, x, y);
+      lastX = x;
+      lastY = y;
+    } else if (touching) {
+      post(TouchEvent::UP, lastX, lastY);
+    }
+    touching = pressed;
+
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(TOUCH_POLL_MS));
+  }
+}
+
+void TouchInput::post(TouchEvent::Type type, uint16_t x, uint16_t y) {
+  TouchEvent e;
+  e.type = type;
+  e.x = x;
+  e.y = y;
+  xQueueSend(events, &e, 0); // queue full: the loop is busy anyway, the event is dropped
+}
@@ -0,0 +1,54 @@
+/**
+ * @file touch_input.h
+ *
+ * @brief touch screen reading moved out of the main loop: a task samples the touch controller every
+ * TOUCH_POLL_MS and posts down / move / up events into a queue, the loop only checks that queue. With the pen
+ * interrupt of the touch controller wired up (irqPin >= 0) the task sleeps until the screen is touched, so no
+ * spi transfer happens at all while nobody touches it. Readings take the spi bus lock like every other user.
+ */
+
+#ifndef TOUCH_INPUT_H
+#define TOUCH_INPUT_H
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include "spi_bus.h"
+
+#define TOUCH_POLL_MS 40 // 25 Hz
+#define TOUCH_QUEUE 16
+#define TOUCH_TASK_STACK 2048
+#define TOUCH_TASK_PRIORITY 1
+#define TOUCH_TASK_CORE 1
+
+struct TouchEvent {
+  enum Type : uint8_t { DOWN, MOVE, UP } type;
+  uint16_t x;
+  uint16_t y;
+};
+
+class TouchInput {
+public:
+  explicit TouchInput(TFT_eSPI *display);
+
+  // start sampling, the touch calibration has to be set already. irqPin < 0: poll all the time
+  bool begin(int8_t irqPin = -1);
+
+  // next event, false if there is none - costs one queue check
+  bool read(TouchEvent *event);
+
+  // drop pending events, e.g. after a screen that read the touch controller itself
+  void clear();
+
+private:
+  static void taskEntry(void *arg);
+  static void IRAM_ATTR onPen(void *arg);
+  void run();
+  void post(TouchEvent::Type type, uint16_t x, uint16_t y);
+
+  TFT_eSPI *tft;
+  QueueHandle_t events;
+  TaskHandle_t task;
+  int8_t irq;
+};
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ * @file uart_ingest.cpp
+ *
+ * @brief uart ingest task, see uart_ingest.h
+ */
+
+#include <driver/gpio.h>
+#include <esp_timer.h>
+#include <hal/uart_ll.h>
+#include "uart_ingest.h"
+
+#define REQUEST_FLUSH 0x80000000u // with a requested rate: drop what was received at the old one
+
+UartIngest serialIn;
+UartIngest serialIn2;
+
+UartIngest::UartIngest()
+  : uart(UART_NUM_2), baud(9600), events(nullptr), task(nullptr), storage(nullptr), byteNs(10000000000ULL / 9600),
+    detecting(false), pending(0),
+    markHead(0), markTail(0), atLineStart(true), stamp(0), bytesIn(0), fifoOverflows(0), driverFull(0),
+    lineErrors(0) {}
+
+bool UartIngest::begin(uart_port_t port, int rxPin, int txPin, uint32_t baudrate, size_t ringSize) {
+  uart = port;
+  baud = baudrate;
+  byteNs = 10000000000ULL / baudrate;
+
+  storage = (uint8_t *)heap_caps_malloc(ringSize, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (!rx.begin(storage, ringSize)) {
+    release();
+    return false;
+  }
+
+  uart_config_t config = {};
+  config.baud_rate = (int)baudrate;
+  config.data_bits = UART_DATA_8_BITS;
+  config.parity = UART_PARITY_DISABLE;
+  config.stop_bits = UART_STOP_BITS_1;
+  config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+  config.source_clk = UART_SCLK_APB;
+
+  if (uart_driver_install(uart, INGEST_DRIVER_BUFFER, INGEST_TX_BUFFER, INGEST_EVENT_QUEUE, &events, 0) != ESP_OK) {
+    release();
+    return false;
+  }
+  uart_param_config(uart, &config);
+  uart_set_pin(uart, txPin, rxPin, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+  uart_set_rx_full_threshold(uart, INGEST_RX_THRESHOLD);
+  gpio_pullup_en((gpio_num_t)rxPin); // an unconnected channel stays idle instead of picking up noise
+
+  // one task per uart at the same priority - each one sleeps on its own event queue, neither can starve the other
+  char name[16];
+  snprintf(name, sizeof(name), "uart%d_ingest", (int)uart);
+  if (xTaskCreatePinnedToCore(taskEntry, name, INGEST_TASK_STACK, this, INGEST_TASK_PRIORITY, &task,
+                              INGEST_TASK_CORE) != pdPASS) {
+    uart_driver_delete(uart);
+    events = nullptr;
+    release();
+    return false;
+  }
+  return true;
+}
+
+// undo a failed begin(): the main loop then sees an empty ring instead of freed memory
+void UartIngest::release() {
+  rx.end();
+  heap_caps_free(storage);
+  storage = nullptr;
+}
+
+void UartIngest::setBaudrate(uint32_t baudrate) {
+  request(baudrate, false);
+}
+
+// uart_set_baudrate() and uart_flush_input() must not run while the ingest task is inside uart_read_bytes(), so
+// the task is handed the rate and woken with an event the driver never sends itself
+void UartIngest::request(uint32_t baudrate, bool flush) {
+  if (baudrate < INGEST_MIN_BAUD) baudrate = INGEST_MIN_BAUD;
+  if (baudrate > INGEST_MAX_BAUD) baudrate = INGEST_MAX_BAUD;
+  baud = baudrate;
+  if (events == nullptr) return; // not started
+  pending.store(baudrate | (flush ? REQUEST_FLUSH : 0));
+  uart_event_t wake = {};
+  wake.type = UART_EVENT_MAX;
+  xQueueSendToFront(events, &wake, 0); // a full queue wakes the task anyway
+}
+
+// ingest task: switch to a requested rate
+void UartIngest::applyRequest() {
+  uint32_t cmd = pending.exchange(0);
+  if (cmd == 0) return;
+
+  uint32_t rate = cmd & ~REQUEST_FLUSH;
+  uart_set_baudrate(uart, rate);
+  byteNs = 10000000000ULL / rate;
+  if (cmd & REQUEST_FLUSH) {
+    uart_flush_input(uart);
+    atLineStart = true;
+  }
+}
+
+void UartIngest::startAutoBaud() {
+  uart_dev_t *hw = UART_LL_GET_HW(uart);
+  hw->auto_baud.glitch_filt = 0x08; // ignore pulses shorter than 8 apb cycles
+  hw->auto_baud.en = 0;             // restarting clears the pulse and edge counters
+  hw->auto_baud.en = 1;
+  detecting = true;
+}
+
+// the shortest low and high pulses are one bit each, averaging both evens out slow signal edges
+uint32_t UartIngest::pollAutoBaud() {
+  static const uint32_t standard[] = {1200, 2400, 4800, 9600, 14400, 19200, 38400, 57600, 74880, 115200, 230400,
+                                      250000, 460800, 500000, 921600, 1000000, 1500000, 2000000};
+  if (!detecting) return 0;
+
+  uart_dev_t *hw = UART_LL_GET_HW(uart);
+  if (hw->rxd_cnt.edge_cnt < INGEST_AUTOBAUD_EDGES) return 0;
+
+  uint32_t cycles = (hw->lowpulse.min_cnt + hw->highpulse.min_cnt + 1) / 2;
+  hw->auto_baud.en = 0;
+  detecting = false;
+  if (cycles == 0) return 0;
+
+  uint32_t measured = APB_CLK_FREQ / cycles;
+  uint32_t rate = measured;
+  for (uint8_t i = 0; i < sizeof(standard) / sizeof(standard[0]); i++) {
+    uint32_t diff = measured > standard[i] ? measured - standard[i] : standard[i] - measured;
+    if (diff * 25 < standard[i]) rate = standard[i]; // within 4%: snap to the common rate
+  }
+  request(rate, true); // what came in during the measurement was read at the wrong rate
+  return baud;
+}
+
+size_t UartIngest::write(const uint8_t *data, size_t len) {
+  int n = uart_write_bytes(uart, (const char *)data, len);
+  return n < 0 ? 0 : n;
+}
+
+int64_t UartIngest::lineStamp(uint32_t pos) {
+  uint32_t t = markTail.load(std::memory_order_relaxed);
+  uint32_t h = markHead.load(std::memory_order_acquire);
+
+  while (t != h && (int32_t)(marks[t & (INGEST_MARK_QUEUE - 1)].pos - pos) <= 0) {
+    stamp = marks[t & (INGEST_MARK_QUEUE - 1)].us;
+    t++;
+  }
+  markTail.store(t, std::memory_order_release);
+  return stamp;
+}
+
+IngestStats UartIngest::stats() const {
+  IngestStats s;
+  s.bytesIn = bytesIn;
+  s.fifoOverflows = fifoOverflows;
+  s.driverFull = driverFull;
+  s.ringDropped = rx.overruns();
+  s.lineErrors = lineErrors;
+  return s;
+}
+
+void UartIngest::taskEntry(void *arg) {
+  static_cast<UartIngest *>(arg)->run();
+}
+
+void UartIngest::run() {
+  uart_event_t event;
+
+  for (;;) {
+    if (xQueueReceive(events, &event, portMAX_DELAY) != pdTRUE) continue;
+    applyRequest(); // whatever woke the task, the bytes behind it may already be at the new rate
+
+    switch (event.type) {
+      case UART_DATA:
+        drain();
+        break;
+
+      case UART_FIFO_OVF: // bytes are already lost - resync like the esp-idf example does
+        fifoOverflows++;
+        uart_flush_input(uart);
+        xQueueReset(events);
+        applyRequest(); // its wake event may just have been reset away
+        break;
+
+      case UART_BUFFER_FULL: // keep what the driver holds, just get it out quickly
+        driverFull++;
+        drain();
+        break;
+
+      case UART_BREAK:
+      case UART_PARITY_ERR:
+      case UART_FRAME_ERR:
+        lineErrors++;
+        break;
+
+      default:
+        break;
+    }
+  }
+}
+
+// move everything the driver has buffered into the ring, reading straight into the free ring space
+void UartIngest::drain() {
+  size_t buffered = 0;
+  uart_get_buffered_data_len(uart, &buffered);
+  int64_t now = esp_timer_get_time(); // roughly when the last buffered byte came in
+
+  while (buffered > 0) {
+    uint8_t *dst;
+    size_t span = rx.writeSpan(&dst);
+
+    if (span == 0) { // consumer is behind: throw away what does not fit and count it
+      uint8_t scratch[128];
+      int n = uart_read_bytes(uart, scratch, buffered < sizeof(scratch) ? buffered : sizeof(scratch), 0);
+      if (n <= 0) break;
+      rx.addDropped(n);
+      buffered -= n;
+      atLineStart = true; // the line start is lost, whatever follows gets a fresh stamp
+      continue;
+    }
+
+    int n = uart_read_bytes(uart, dst, buffered < span ? buffered : span, 0);
+    if (n <= 0) break;
+    buffered -= n;
+    markLines(rx.writePos(), dst, n, now - (int64_t)((uint64_t)buffered * byteNs / 1000));
+    rx.commit(n); // marks are published first, so the main loop finds them together with the bytes
+    bytesIn += n;
+  }
+}
+
+// mark the first byte after every '\r'. bytes are assumed to have arrived back to back up to lastByteUs
+void UartIngest::markLines(uint32_t pos, const uint8_t *data, size_t len, int64_t lastByteUs) {
+  size_t i = 0;
+
+  while (i < len) {
+    if (atLineStart) {
+      uint32_t h = markHead.load(std::memory_order_relaxed);
+      if (h - markTail.load(std::memory_order_acquire) < INGEST_MARK_QUEUE) { // full: line inherits the last stamp
+        marks[h & (INGEST_MARK_QUEUE - 1)].pos = pos + i;
+        marks[h & (INGEST_MARK_QUEUE - 1)].us = lastByteUs - (int64_t)((uint64_t)(len - 1 - i) * byteNs / 1000);
+        markHead.store(h + 1, std::memory_order_release);
+      }
+      atLineStart = false;
+    }
+    const uint8_t *cr = (const uint8_t *)memchr(data + i, '\r', len - i);
+    if (cr == nullptr) break;
+    i = cr - data + 1;
+    atLineStart = true;
+  }
+}
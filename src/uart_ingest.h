@@ -0,0 +1,114 @@
+/**
+ * @file uart_ingest.h
+ *
+ * @brief serial capture decoupled from the display: a FreeRTOS task pinned to core 0 waits on the esp-idf uart
+ * event queue and moves received bytes in bulk into a ByteRing. The main loop on core 1 renders and forwards from
+ * that ring at its own pace, so OTA, mqtt or telnet stalls no longer overrun the 128 byte hardware fifo.
+ *
+ * The task also records when every line started: for the first byte after each '\r' a mark (ring position,
+ * esp_timer time) goes into a second lock-free queue. The time is taken when the driver hands the bytes over and
+ * backdated by their transmission time, so it does not depend on how late the main loop renders the line.
+ *
+ * Any baud rate up to INGEST_MAX_BAUD can be set. For unknown targets the uart's auto baud unit measures the
+ * shortest low and high pulses of the incoming signal, pollAutoBaud() turns them into a rate once enough edges
+ * have been seen - without blocking, the main loop just keeps asking. A new rate is only requested by the main
+ * loop, the ingest task switches the driver over itself between two reads.
+ */
+
+#ifndef UART_INGEST_H
+#define UART_INGEST_H
+
+#include <Arduino.h>
+#include <driver/uart.h>
+#include "ring_buffer.h"
+
+#define INGEST_RING_SIZE (32 * 1024)  // must be a power of two
+#define INGEST_DRIVER_BUFFER 8192     // esp-idf driver side rx buffer, filled from the uart isr - 40 ms at 2 Mbaud
+#define INGEST_RX_THRESHOLD 64        // fifo level that raises the rx interrupt, leaves 320 us of slack at 2 Mbaud
+#define INGEST_TX_BUFFER 2048         // writes to the target (raw bridge) return once copied here
+#define INGEST_EVENT_QUEUE 32
+#define INGEST_TASK_STACK 3072
+#define INGEST_TASK_PRIORITY 12
+#define INGEST_TASK_CORE 0
+#define INGEST_MARK_QUEUE 512         // line start marks not yet picked up by the main loop, power of two
+#define INGEST_MIN_BAUD 300
+#define INGEST_MAX_BAUD 5000000       // apb clock / 16
+#define INGEST_AUTOBAUD_EDGES 30      // edges to see before the measured pulse widths are trusted
+
+struct LineMark {
+  uint32_t pos; // ring position of the first byte of the line
+  int64_t us;   // esp_timer_get_time() when it was received
+};
+
+struct IngestStats {
+  uint32_t bytesIn;       // bytes moved from the uart driver into the ring
+  uint32_t fifoOverflows; // hardware fifo overflowed before the isr could empty it
+  uint32_t driverFull;    // esp-idf driver buffer ran full (ingest task starved)
+  uint32_t ringDropped;   // bytes dropped because the consumer did not keep up
+  uint32_t lineErrors;    // framing, parity and break events
+};
+
+class UartIngest {
+public:
+  UartIngest();
+
+  // false if the ring cannot be allocated, the driver not installed or the task not started - nothing is kept then
+  bool begin(uart_port_t port, int rxPin, int txPin, uint32_t baudrate, size_t ringSize = INGEST_RING_SIZE);
+  // clamped to INGEST_MIN_BAUD .. INGEST_MAX_BAUD, baudrate() reports it right away, the uart follows as soon
+  // as the ingest task gets to it
+  void setBaudrate(uint32_t baudrate);
+  uint32_t baudrate() const { return baud; }
+
+  // measure the baud rate of the incoming signal. pollAutoBaud() returns 0 while still measuring, otherwise the
+  // detected rate - which is then already requested like with setBaudrate()
+  void startAutoBaud();
+  uint32_t pollAutoBaud();
+  bool autoBaudActive() const { return detecting; }
+
+  // send to the target, blocks only while the driver tx buffer is full
+  size_t write(const uint8_t *data, size_t len);
+
+  // consumer access for the main loop
+  ByteRing &ring() { return rx; }
+
+  // receive time of the line which contains ring position pos. positions have to be asked for in increasing
+  // order, marks up to pos are used up
+  int64_t lineStamp(uint32_t pos);
+
+  IngestStats stats() const;
+
+private:
+  static void taskEntry(void *arg);
+  void run();
+  void drain();
+  void markLines(uint32_t pos, const uint8_t *data, size_t len, int64_t lastByteUs);
+  void release();
+  void request(uint32_t baudrate, bool flush);
+  void applyRequest();
+
+  uart_port_t uart;
+  uint32_t baud;
+  QueueHandle_t events;
+  TaskHandle_t task;
+  uint8_t *storage;
+  ByteRing rx;
+  uint32_t byteNs; // duration of one 10 bit character at the current baud rate
+  bool detecting;
+  std::atomic<uint32_t> pending; // rate for the ingest task to switch to plus flush bit, 0 = none
+
+  LineMark marks[INGEST_MARK_QUEUE];
+  std::atomic<uint32_t> markHead; // written by the ingest task only
+  std::atomic<uint32_t> markTail; // written by the main loop only
+  bool atLineStart;               // ingest task: the next byte starts a line
+  int64_t stamp;                  // main loop: last mark used
+
+  volatile uint32_t bytesIn;
+  volatile uint32_t fifoOverflows;
+  volatile uint32_t driverFull;
+  volatile uint32_t lineErrors;
+};
+
+extern UartIngest serialIn;  // main channel on serial2
+extern UartIngest serialIn2; // second channel on serial1
+
+#endif
@@ -0,0 +1,92 @@
+/**
+ * @file wifi_link.cpp
+ *
+ * @brief wifi connection handling, see wifi_link.h
+ */
+
+#include "wifi_link.h"
+
+WifiLink wifi;
+
+WifiLink::WifiLink()
+  : ssid(""), password(""), up(false), connectedFlag(false), reason(0), downAt(0), upAt(0), drops(0),
+    connecting(false), attempt(false), attemptAt(0), retryMs(WIFI_RETRY_MIN_MS), nextRetry(0) {}
+
+void WifiLink::begin(const char *networkName, const char *networkPassword, const char *hostname) {
+  ssid = networkName;
+  password = networkPassword;
+  downAt = millis();
+
+  WiFi.persistent(false); // credentials come from the secrets file, no flash writes on every begin()
+  WiFi.mode(WIFI_STA);
+  WiFi.setHostname(hostname);
+  WiFi.setAutoReconnect(false); // retries are paced by handle()
+  WiFi.onEvent(onEvent);
+  connect();
+}
+
+// returns immediately, the result arrives as an event
+void WifiLink::connect() {
+  connecting = true;
+  attempt = true;
+  attemptAt = millis();
+  nextRetry = attemptAt + WIFI_CONNECT_TIMEOUT_MS;
+  WiFi.begin(ssid, password);
+}
+
+// runs in the arduino event task - only record what happened, the main loop acts on it
+void WifiLink::onEvent(WiFiEvent_t event, WiFiEventInfo_t info) {
+  switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+      wifi.up = true;
+      wifi.connecting = false;
+      wifi.connectedFlag = true;
+      wifi.upAt = millis();
+      break;
+
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+      if (wifi.up) {
+        wifi.drops++;
+        wifi.downAt = millis();
+      }
+      wifi.up = false;
+      wifi.connecting = false;
+      wifi.reason = info.wifi_sta_disconnected.reason;
+      break;
+
+    default:
+      break;
+  }
+}
+
+void WifiLink::handle() {
+  if (up) {
+    attempt = false;
+    retryMs = WIFI_RETRY_MIN_MS;
+    nextRetry = millis() + retryMs; // first retry after a drop
+    return;
+  }
+
+  if (attempt) {
+    if (connecting && millis() - attemptAt < WIFI_CONNECT_TIMEOUT_MS) return; // still associating or in dhcp
+    // failed or timed out: abort what may still be running, the next attempt follows after the backoff
+    if (connecting) WiFi.disconnect();
+    attempt = false;
+    nextRetry = millis() + retryMs;
+    retryMs = retryMs * 2 > WIFI_RETRY_MAX_MS ? WIFI_RETRY_MAX_MS : retryMs * 2;
+    return;
+  }
+  if ((int32_t)(millis() - nextRetry) < 0) return;
+  connect();
+}
+
+bool WifiLink::takeConnected() {
+  if (!connectedFlag) return false;
+  connectedFlag = false;
+  return true;
+}
+
+uint32_t WifiLink::offlineMs() const {
+  if (!up) return millis() - downAt;
+  return upAt - downAt;
+}
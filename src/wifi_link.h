@@ -0,0 +1,60 @@
+/**
+ * @file wifi_link.h
+ *
+ * @brief event driven wifi station: WiFi.begin() returns right away, connection changes arrive through
+ * WiFi.onEvent() and a lost link is retried from handle() with a growing interval. A running attempt is left
+ * alone until it fails (disconnect event) or WIFI_CONNECT_TIMEOUT_MS pass, association and dhcp often take
+ * several seconds. Nothing here delays or
+ * restarts the device, so display, history and capture keep running while the network is away.
+ */
+
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#define WIFI_RETRY_MIN_MS 2000
+#define WIFI_RETRY_MAX_MS 60000
+#define WIFI_CONNECT_TIMEOUT_MS 15000 // an attempt without a disconnect event or an ip by then is given up
+
+class WifiLink {
+public:
+  WifiLink();
+
+  void begin(const char *ssid, const char *password, const char *hostname);
+
+  // retries a lost connection, call once per loop pass
+  void handle();
+
+  bool online() const { return up; }
+
+  // true once for every (re)connect - lets network consumers resume from where they stopped
+  bool takeConnected();
+
+  uint32_t offlineMs() const;     // duration of the last / current outage
+  uint32_t disconnects() const { return drops; }
+  uint8_t lastReason() const { return reason; }
+
+private:
+  static void onEvent(WiFiEvent_t event, WiFiEventInfo_t info);
+  void connect();
+
+  const char *ssid;
+  const char *password;
+  volatile bool up;
+  volatile bool connectedFlag;
+  volatile uint8_t reason;     // wifi_err_reason_t of the last disconnect
+  volatile uint32_t downAt;    // millis() of the last disconnect
+  volatile uint32_t upAt;      // millis() of the last got ip
+  volatile uint32_t drops;
+  volatile bool connecting;    // the attempt started last has neither failed nor succeeded yet
+  bool attempt;                // main loop: waiting for the result of an attempt
+  uint32_t attemptAt;          // millis() of its start
+  uint32_t retryMs;
+  uint32_t nextRetry;
+};
+
+extern WifiLink wifi;
+
+#endif
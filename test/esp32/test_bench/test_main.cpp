@@ -0,0 +1,189 @@
+/**
+ * @file test_main.cpp
+ *
+ * @brief on target benchmark of the capture pipeline: serial2 is switched to the uart's internal loop-back, so
+ * what is written to the target comes straight back in through the ingest task - no wiring needed. Every loop
+ * pass writes one line and drains the ring like drainChannel() does, with assembly, filter, history and the line
+ * sprite on the display timed on their own. Reports microseconds per line for every stage, the latency from the
+ * first byte of a line received to its row pushed, and fails when a baud rate up to 921600 loses bytes.
+ * Run with "pio test -e esp32dev_bench -v".
+ */
+
+#include <Arduino.h>
+#include <TFT_eSPI.h>
+#include <esp_timer.h>
+#include <unity.h>
+#include "history.h"
+#include "line_assembler.h"
+#include "line_filter.h"
+#include "line_renderer.h"
+#include "uart_ingest.h"
+
+#define BENCH_LINES 3000
+#define BENCH_LOOP_BUDGET 2048 // like RX_LOOP_BUDGET
+#define BENCH_ROW_HEIGHT 16
+#define BENCH_FILTER "+ERROR|+WARN|-heartbeat|*abort"
+
+struct StageTimes {
+  uint64_t assemble;
+  uint64_t filter;
+  uint64_t history;
+  uint64_t render;
+  uint32_t lines;
+  int64_t latencyMax;
+  uint64_t latencySum;
+};
+
+TFT_eSPI tft = TFT_eSPI();
+static LineRenderer lineOut(&tft);
+static LineAssembler lines;
+static LineFilter filter;
+static LineHistory history;
+static uint8_t arena[HISTORY_RAM_BYTES];
+static LineHistory::Block blocks[HISTORY_RAM_BLOCKS];
+
+void setUp() {}
+void tearDown() {}
+
+static size_t makeLine(uint32_t i, char *out, size_t cap) {
+  switch (i % 4) {
+    case 0: return snprintf(out, cap, "\x1b[0;32mI (%u) app: heartbeat %u free heap %u\x1b[0m\r\n", i * 17, i, 180000 - i % 4000);
+    case 1: return snprintf(out, cap, "\x1b[0;33mW (%u) wifi: WARN rssi %d dBm, retry %u\x1b[0m\r\n", i * 17, -40 - (int)(i % 50), i % 7);
+    case 2: return snprintf(out, cap, "D (%u) sensor: t=%u.%u h=%u p=%u\r\n", i * 17, 20 + i % 5, i % 10, 40 + i % 30, 1000 + i % 20);
+    default: return snprintf(out, cap, "\x1b[0;31mE (%u) task: ERROR queue full after %u items, dropping the oldest\x1b[0m\r\n", i * 17, i % 512);
+  }
+}
+
+// everything which is already in the ring, the way drainChannel() handles it
+static void drain(UartIngest &in, StageTimes &t, bool &started, int64_t &stamp, int16_t &y) {
+  const uint8_t *chunk;
+  size_t len;
+  size_t budget = BENCH_LOOP_BUDGET;
+
+  while (budget > 0 && (len = in.ring().peek(&chunk)) > 0) {
+    if (len > budget) len = budget;
+    const uint8_t *p = chunk;
+    size_t left = len;
+
+    while (left > 0) {
+      if (!started) {
+        stamp = in.lineStamp(in.ring().readPos() + (p - chunk));
+        started = true;
+      }
+      int64_t t0 = esp_timer_get_time();
+      size_t n = lines.feed(p, left);
+      int64_t t1 = esp_timer_get_time();
+      t.assemble += t1 - t0;
+
+      if (lines.complete()) {
+        bool lineEnd = !lines.wrapped();
+        lineOut.update(lines.text(), lines.length(), y);
+        lineOut.newLine();
+        y = (y + BENCH_ROW_HEIGHT) % (tft.height() - BENCH_ROW_HEIGHT);
+        int64_t t2 = esp_timer_get_time();
+        t.render += t2 - t1;
+        if (lineEnd) {
+          bool highlight;
+          filter.accept(lines.line(), lines.lineLength(), &highlight);
+          int64_t t3 = esp_timer_get_time();
+          history.append(lines.line(), lines.lineLength(), stamp, 0);
+          int64_t t4 = esp_timer_get_time();
+          t.filter += t3 - t2;
+          t.history += t4 - t3;
+          int64_t latency = t2 - stamp;
+          t.latencySum += latency;
+          if (latency > t.latencyMax) t.latencyMax = latency;
+          t.lines++;
+          started = false;
+        }
+        lines.next();
+      }
+      p += n;
+      left -= n;
+    }
+    in.ring().consume(len);
+    budget -= len;
+  }
+}
+
+static uint32_t run(uint32_t baud) {
+  UartIngest &in = serialIn;
+  in.setBaudrate(baud);
+  delay(20);
+  in.ring().consume(in.ring().available()); // leftovers of the previous rate
+  lines = LineAssembler();
+  lines.setAdvances(lineOut.advances());
+  lines.setWrapWidth(tft.width() - 10);
+
+  StageTimes t;
+  memset(&t, 0, sizeof(t));
+  bool started = false;
+  int64_t stamp = 0;
+  int16_t y = 0;
+  IngestStats before = in.stats();
+  int64_t start = esp_timer_get_time();
+  uint32_t sent = 0;
+
+  char line[128];
+  for (uint32_t i = 0; i < BENCH_LINES; i++) {
+    size_t n = makeLine(i, line, sizeof(line));
+    sent += in.write((const uint8_t *)line, n); // paces the loop at the wire rate once the tx buffer is full
+    drain(in, t, started, stamp, y);
+  }
+  // the last lines are still on the wire
+  int64_t idle = esp_timer_get_time();
+  while (esp_timer_get_time() - idle < 50000) {
+    if (in.ring().available()) idle = esp_timer_get_time();
+    drain(in, t, started, stamp, y);
+  }
+  lineOut.flush();
+  int64_t elapsed = esp_timer_get_time() - start;
+
+  IngestStats after = in.stats();
+  uint32_t lost = after.ringDropped - before.ringDropped + after.fifoOverflows - before.fifoOverflows +
+                  after.driverFull - before.driverFull;
+  uint32_t l = t.lines ? t.lines : 1;
+  printf("%8u baud: %u of %u bytes in %u ms, %u lines, per line us: assemble %u filter %u history %u render %u, "
+         "latency avg %u us max %u us, fifo overflows %u, driver full %u, ring dropped %u\n",
+         (unsigned)baud, (unsigned)(after.bytesIn - before.bytesIn), (unsigned)sent, (unsigned)(elapsed / 1000),
+         (unsigned)t.lines, (unsigned)(t.assemble / l), (unsigned)(t.filter / l), (unsigned)(t.history / l),
+         (unsigned)(t.render / l), (unsigned)(t.latencySum / l), (unsigned)t.latencyMax,
+         (unsigned)(after.fifoOverflows - before.fifoOverflows), (unsigned)(after.driverFull - before.driverFull),
+         (unsigned)(after.ringDropped - before.ringDropped));
+  return lost;
+}
+
+void test_loopback_230400() {
+  TEST_ASSERT_EQUAL(0, run(230400));
+}
+
+void test_loopback_921600() {
+  TEST_ASSERT_EQUAL(0, run(921600));
+}
+
+void test_loopback_2000000() {
+  run(2000000); // beyond the rated speed, shown for comparison only
+}
+
+void setup() {
+  delay(2000); // the test runner opens the port after the reset
+
+  tft.init();
+  tft.setRotation(0);
+  tft.fillScreen(TFT_BLACK);
+  lineOut.enableDma(tft.initDMA());
+  lineOut.begin(tft.width(), BENCH_ROW_HEIGHT, nullptr);
+  history.begin(arena, sizeof(arena), blocks, HISTORY_RAM_BLOCKS);
+  filter.compile(BENCH_FILTER);
+
+  serialIn.begin(UART_NUM_2, 16, 17, 230400);
+  uart_set_loop_back(UART_NUM_2, true); // tx back into rx inside the uart
+
+  UNITY_BEGIN();
+  RUN_TEST(test_loopback_230400);
+  RUN_TEST(test_loopback_921600);
+  RUN_TEST(test_loopback_2000000);
+  UNITY_END();
+}
+
+void loop() {}
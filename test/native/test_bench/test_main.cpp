@@ -0,0 +1,198 @@
+/**
+ * @file test_main.cpp
+ *
+ * @brief host soak benchmark of the capture pipeline. A recorded capture (test/captures/, or BENCH_CAPTURE=<file>)
+ * is replayed at simulated baud rates: bytes arrive on a simulated clock in uart fifo sized pieces and go into
+ * a ByteRing like the ingest task puts them, the consumer side runs the real line assembler, filter and history
+ * like drainChannel() and advances the clock by its measured run time times BENCH_CPU_SCALE plus a fixed cost
+ * for the rest of the loop pass. Reports throughput, per line latency (last byte on the wire to line stored) and
+ * ring drops, and fails when a rate the monitor is meant to sustain drops bytes.
+ * Run with "pio test -e native -f native/test_bench -v" to see the report.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+#include "history.h"
+#include "line_assembler.h"
+#include "line_filter.h"
+#include "ring_buffer.h"
+#include "text_layout.h"
+
+#define BENCH_RING_SIZE (32 * 1024)    // like INGEST_RING_SIZE
+#define BENCH_FIFO_CHUNK 64            // like INGEST_RX_THRESHOLD, the ingest task wakes per fifo interrupt
+#define BENCH_LOOP_BUDGET 2048         // like RX_LOOP_BUDGET
+#define BENCH_LOOP_OVERHEAD_US 300     // display, network and touch handling of one loop pass
+#define BENCH_CPU_SCALE 15             // a 240 MHz esp32 core against one desktop core
+#define BENCH_BYTES (2 * 1024 * 1024)  // the capture is repeated up to this size
+#define BENCH_FILTER "+ERROR|+WARN|-heartbeat|*abort"
+#define BENCH_DEFAULT_CAPTURE "test/captures/esp32_boot.log"
+
+struct BenchResult {
+  double wallMBps;  // pipeline speed on this machine
+  double load;      // share of the simulated time the consumer was busy
+  uint32_t lines;
+  double p50Ms;
+  double p99Ms;
+  double maxMs;
+  uint32_t dropped;
+};
+
+static std::vector<uint8_t> capture;
+
+void setUp() {}
+void tearDown() {}
+
+static void loadCapture() {
+  const char *name = getenv("BENCH_CAPTURE");
+  FILE *f = fopen(name ? name : BENCH_DEFAULT_CAPTURE, "rb");
+  std::vector<uint8_t> one;
+  if (f) {
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) one.insert(one.end(), buf, buf + n);
+    fclose(f);
+  }
+  if (one.empty()) { // no recording at hand: synthetic log lines
+    char line[96];
+    for (unsigned i = 0; i < 1000; i++) {
+      int n = snprintf(line, sizeof(line), "\x1b[0;32mI (%u) app: heartbeat %u free heap %u\x1b[0m\r\n", i * 17, i,
+                       180000 - i % 4000);
+      one.insert(one.end(), line, line + n);
+    }
+  }
+  capture.clear();
+  while (capture.size() < BENCH_BYTES) capture.insert(capture.end(), one.begin(), one.end());
+}
+
+static double percentile(std::vector<double> &v, double p) {
+  if (v.empty()) return 0;
+  size_t i = (size_t)(p * (v.size() - 1));
+  std::nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i];
+}
+
+static BenchResult replay(uint32_t baud) {
+  static uint8_t storage[BENCH_RING_SIZE];
+  static uint8_t arena[HISTORY_RAM_BYTES];
+  static LineHistory::Block index[HISTORY_RAM_BLOCKS];
+  static LineHistory history;
+  static LineAssembler lines;
+  static LineFilter filter;
+
+  ByteRing ring;
+  ring.begin(storage, sizeof(storage));
+  history.begin(arena, sizeof(arena), index, HISTORY_RAM_BLOCKS);
+  filter.compile(BENCH_FILTER);
+  lines = LineAssembler();
+  lines.setAdvances(layoutAdvances(LAYOUT_MONO9));
+  lines.setWrapWidth(310);
+
+  const double byteNs = 10e9 / baud; // 8N1
+  const size_t total = capture.size();
+  std::vector<double> latency;
+  size_t arrived = 0;  // bytes handed to the ring
+  size_t consumed = 0; // stream offset of the ring's read position
+  uint32_t shown = 0;
+  double now = 0;
+  double busy = 0;
+  double wall = 0;
+
+  while (consumed + ring.available() < total || ring.available() > 0) {
+    // producer: every full fifo chunk which has arrived on the wire by now
+    while (arrived < total) {
+      size_t n = total - arrived < BENCH_FIFO_CHUNK ? total - arrived : BENCH_FIFO_CHUNK;
+      if ((arrived + n) * byteNs > now) break;
+      ring.write(capture.data() + arrived, n); // what does not fit is counted as overrun
+      arrived += n;
+    }
+    if (ring.available() == 0) {
+      if (arrived >= total) break;
+      size_t n = total - arrived < BENCH_FIFO_CHUNK ? total - arrived : BENCH_FIFO_CHUNK;
+      now = (arrived + n) * byteNs; // idle until the next interrupt
+      continue;
+    }
+
+    // consumer: one loop pass of drainChannel()
+    std::vector<size_t> ends; // stream offsets of the line ends handled in this pass
+    auto start = std::chrono::steady_clock::now();
+    size_t budget = BENCH_LOOP_BUDGET;
+    const uint8_t *chunk;
+    size_t len;
+    while (budget > 0 && (len = ring.peek(&chunk)) > 0) {
+      if (len > budget) len = budget;
+      size_t left = len;
+      const uint8_t *p = chunk;
+      while (left > 0) {
+        size_t n = lines.feed(p, left);
+        if (lines.complete()) {
+          if (!lines.wrapped()) {
+            bool highlight;
+            history.append(lines.line(), lines.lineLength(), 0, 0);
+            shown += filter.accept(lines.line(), lines.lineLength(), &highlight);
+            ends.push_back(consumed + (p - chunk) + n);
+          }
+          lines.next();
+        }
+        p += n;
+        left -= n;
+      }
+      ring.consume(len);
+      consumed += len;
+      budget -= len;
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    wall += ns;
+    busy += ns * BENCH_CPU_SCALE;
+    now += ns * BENCH_CPU_SCALE + BENCH_LOOP_OVERHEAD_US * 1000.0;
+
+    // bytes dropped by the ring never reach the consumer, so offsets are approximate once there were drops
+    for (size_t e : ends) latency.push_back((now - e * byteNs) / 1e6);
+  }
+
+  BenchResult r;
+  r.wallMBps = wall > 0 ? consumed / wall * 1e3 : 0;
+  r.load = now > 0 ? busy / now : 0;
+  r.lines = latency.size();
+  r.p50Ms = percentile(latency, 0.5);
+  r.p99Ms = percentile(latency, 0.99);
+  r.maxMs = latency.empty() ? 0 : *std::max_element(latency.begin(), latency.end());
+  r.dropped = ring.overruns();
+  (void)shown;
+  return r;
+}
+
+static BenchResult report(uint32_t baud) {
+  BenchResult r = replay(baud);
+  printf("%8u baud: %7.1f MB/s host, %5.1f %% load, %6u lines, latency p50 %6.2f ms p99 %6.2f ms max %6.2f ms, "
+         "%u bytes dropped\n",
+         (unsigned)baud, r.wallMBps, r.load * 100, (unsigned)r.lines, r.p50Ms, r.p99Ms, r.maxMs, (unsigned)r.dropped);
+  return r;
+}
+
+void test_sustains_230400() {
+  TEST_ASSERT_EQUAL(0, report(230400).dropped);
+}
+
+void test_sustains_921600() {
+  TEST_ASSERT_EQUAL(0, report(921600).dropped);
+}
+
+void test_reports_2000000() {
+  BenchResult r = report(2000000); // beyond the rated speed, shown for comparison only
+  TEST_ASSERT_GREATER_THAN(0, r.lines);
+}
+
+int main() {
+  loadCapture();
+  printf("capture: %u bytes\n", (unsigned)capture.size());
+  UNITY_BEGIN();
+  RUN_TEST(test_sustains_230400);
+  RUN_TEST(test_sustains_921600);
+  RUN_TEST(test_reports_2000000);
+  return UNITY_END();
+}
@@ -0,0 +1,242 @@
+/**
+ * @file test_main.cpp
+ *
+ * @brief host unit tests of the pure c++ pipeline modules: rings, escape decoder, line assembler and layout,
+ * filter, block codec and history. Run with "pio test -e native".
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unity.h>
+#include "ansi_decoder.h"
+#include "block_codec.h"
+#include "history.h"
+#include "line_assembler.h"
+#include "line_filter.h"
+#include "ring_buffer.h"
+#include "text_layout.h"
+
+void setUp() {}
+void tearDown() {}
+
+// feed text until a row is complete, returns the bytes used
+static size_t feedRow(LineAssembler &a, const char *text) {
+  size_t used = 0;
+  size_t len = strlen(text);
+  while (used < len && !a.complete()) used += a.feed((const uint8_t *)text + used, len - used);
+  return used;
+}
+
+void test_byte_ring_wraps_and_counts_drops() {
+  uint8_t storage[16];
+  ByteRing ring;
+  TEST_ASSERT_TRUE(ring.begin(storage, sizeof(storage)));
+  TEST_ASSERT_FALSE(ring.begin(storage, 12)); // not a power of two
+
+  uint8_t data[32];
+  for (uint8_t i = 0; i < sizeof(data); i++) data[i] = i;
+  ring.write(data, 10);
+  ring.consume(10);
+  TEST_ASSERT_EQUAL(12, ring.write(data, 12));
+
+  const uint8_t *p;
+  TEST_ASSERT_EQUAL(6, ring.peek(&p)); // up to the end of the storage
+  TEST_ASSERT_EQUAL_MEMORY(data, p, 6);
+  ring.consume(6);
+  TEST_ASSERT_EQUAL(6, ring.peek(&p));
+  TEST_ASSERT_EQUAL_MEMORY(data + 6, p, 6);
+  ring.consume(6);
+
+  TEST_ASSERT_EQUAL(16, ring.write(data, 20));
+  TEST_ASSERT_EQUAL(4, ring.overruns());
+  TEST_ASSERT_EQUAL(16, ring.highWater());
+}
+
+void test_broadcast_ring_overwrites_oldest() {
+  uint8_t storage[16];
+  BroadcastRing ring;
+  TEST_ASSERT_TRUE(ring.begin(storage, sizeof(storage)));
+
+  uint32_t reader = ring.writePos();
+  ring.write((const uint8_t *)"0123456789", 10);
+  ring.write((const uint8_t *)"abcdefghij", 10);
+  TEST_ASSERT_EQUAL(20, ring.writePos() - reader); // the reader fell behind by more than the capacity
+
+  uint32_t late = ring.writePos() - ring.capacity();
+  const uint8_t *p;
+  size_t n = ring.peek(late, &p);
+  TEST_ASSERT_EQUAL(12, n);
+  TEST_ASSERT_EQUAL_MEMORY("456789abcdef", p, n);
+  TEST_ASSERT_EQUAL(4, ring.peek(late + n, &p));
+  TEST_ASSERT_EQUAL_MEMORY("ghij", p, 4);
+}
+
+void test_ansi_sequence_split_across_chunks() {
+  AnsiDecoder d;
+  const char *first = "\x1b[3";
+  for (const char *c = first; *c; c++) TEST_ASSERT_EQUAL(AnsiDecoder::ANSI_NONE, d.step(*c));
+  TEST_ASSERT_EQUAL(AnsiDecoder::ANSI_NONE, d.step('1'));
+  TEST_ASSERT_EQUAL(AnsiDecoder::ANSI_COLOUR, d.step('m'));
+  TEST_ASSERT_EQUAL(2, d.colour()); // SGR 31
+  TEST_ASSERT_EQUAL(AnsiDecoder::ANSI_PRINT, d.step('x'));
+  TEST_ASSERT_EQUAL(AnsiDecoder::ANSI_EXECUTE, d.step('\r'));
+
+  char sgr[8];
+  size_t n = AnsiDecoder::sgr(d.colour(), sgr);
+  TEST_ASSERT_EQUAL(5, n);
+  TEST_ASSERT_EQUAL_MEMORY("\x1b[31m", sgr, n);
+}
+
+void test_assembler_keeps_colours_as_markers() {
+  LineAssembler a;
+  const char *in = "abc\x1b[32mdef\x1b[0m\r\n";
+  size_t used = feedRow(a, in);
+  TEST_ASSERT_TRUE(a.complete());
+  TEST_ASSERT_FALSE(a.wrapped());
+
+  const char expect[] = {'a', 'b', 'c', LINE_COLOUR_MARKER + 3, 'd', 'e', 'f'};
+  TEST_ASSERT_EQUAL(sizeof(expect), a.lineLength());
+  TEST_ASSERT_EQUAL_MEMORY(expect, a.line(), sizeof(expect));
+
+  char plain[16];
+  TEST_ASSERT_EQUAL(6, stripMarkers(plain, a.line(), a.lineLength()));
+  TEST_ASSERT_EQUAL_MEMORY("abcdef", plain, 6);
+
+  a.next();
+  feedRow(a, in + used); // only the '\n' is left, it starts no row
+  TEST_ASSERT_FALSE(a.complete());
+  TEST_ASSERT_EQUAL(0, a.lineLength());
+}
+
+void test_assembler_rows_match_layout() {
+  const char *in = "the quick brown fox jumps over the lazy dog and keeps running along the river\r";
+  const uint8_t *adv = layoutAdvances(LAYOUT_MONO9);
+  const uint16_t width = 120;
+  LineAssembler a;
+  a.setAdvances(adv);
+  a.setWrapWidth(width);
+
+  size_t used = 0;
+  size_t starts[LAYOUT_MAX_ROWS];
+  uint8_t rows = 0;
+  for (;;) {
+    used += feedRow(a, in + used);
+    TEST_ASSERT_TRUE(a.complete());
+    starts[rows++] = a.rowStart();
+    if (!a.wrapped()) break;
+    a.next();
+  }
+  TEST_ASSERT_GREATER_THAN(1, rows);
+
+  LayoutCache cache;
+  cache.begin(adv, width);
+  const LineLayout &l = cache.get(1, a.line(), a.lineLength());
+  TEST_ASSERT_EQUAL(rows, l.rows);
+  for (uint8_t r = 0; r < rows; r++) TEST_ASSERT_EQUAL(starts[r], l.begin(r));
+  TEST_ASSERT_TRUE(cache.cached(1));
+  for (uint8_t r = 0; r + 1 < rows; r++) TEST_ASSERT_EQUAL(' ', a.line()[l.finish(r) - 1]); // broken after words
+}
+
+void test_filter_include_exclude_highlight() {
+  LineFilter f;
+  bool highlight;
+  TEST_ASSERT_TRUE(f.accept("anything", 8, &highlight)); // no rules
+  TEST_ASSERT_TRUE(f.compile("+ERROR|+assert|-heartbeat|*WARN"));
+  TEST_ASSERT_TRUE(f.filtering());
+  TEST_ASSERT_EQUAL(4, f.rules());
+
+  TEST_ASSERT_TRUE(f.accept("E (12) ERROR here", 17, &highlight));
+  TEST_ASSERT_FALSE(highlight);
+  TEST_ASSERT_FALSE(f.accept("heartbeat ERROR", 15, &highlight));
+  TEST_ASSERT_FALSE(f.accept("just info", 9, &highlight));
+  TEST_ASSERT_TRUE(f.accept("WARN assert failed", 18, &highlight));
+  TEST_ASSERT_TRUE(highlight);
+
+  TEST_ASSERT_FALSE(f.compile("no action"));
+  TEST_ASSERT_EQUAL_STRING("+ERROR|+assert|-heartbeat|*WARN", f.spec()); // the old rules stay
+  TEST_ASSERT_TRUE(f.compile(""));
+  TEST_ASSERT_EQUAL(0, f.rules());
+}
+
+void test_filter_matches_across_colours() {
+  LineFilter f;
+  bool highlight;
+  TEST_ASSERT_TRUE(f.compile("+ERROR|*timeout"));
+
+  LineAssembler a;
+  feedRow(a, "E (42) \x1b[31mERR\x1b[1;31mOR\x1b[0m: time\x1b[33mout\r\n");
+  TEST_ASSERT_TRUE(a.complete());
+  char plain[64];
+  TEST_ASSERT_GREATER_THAN(stripMarkers(plain, a.line(), a.lineLength()), a.lineLength()); // markers in the line
+  TEST_ASSERT_TRUE(f.accept(a.line(), a.lineLength(), &highlight));
+  TEST_ASSERT_TRUE(highlight);
+}
+
+void test_codec_round_trip() {
+  static BlockCodec codec;
+  static uint8_t src[HISTORY_BLOCK_BYTES];
+  static uint8_t packed[HISTORY_BLOCK_BYTES];
+  static uint8_t out[HISTORY_BLOCK_BYTES];
+
+  size_t len = 0;
+  for (unsigned i = 0; len + 64 < sizeof(src); i++) {
+    len += snprintf((char *)src + len, sizeof(src) - len, "I (%u) wifi: sta rssi -%u dBm\n", i * 37, 40 + i % 30);
+  }
+  size_t n = codec.pack(src, len, packed, len - 1);
+  TEST_ASSERT_GREATER_THAN(0, n);
+  TEST_ASSERT_LESS_OR_EQUAL(len / 2, n); // repetitive log text packs well
+  TEST_ASSERT_EQUAL(len, BlockCodec::unpack(packed, n, out, sizeof(out)));
+  TEST_ASSERT_EQUAL_MEMORY(src, out, len);
+
+  uint32_t x = 1;
+  for (size_t i = 0; i < sizeof(src); i++) src[i] = (x = x * 1103515245 + 12345) >> 24;
+  TEST_ASSERT_EQUAL(0, codec.pack(src, sizeof(src), packed, sizeof(src) - 1)); // noise does not shrink
+
+  TEST_ASSERT_EQUAL(0, BlockCodec::unpack((const uint8_t *)"\x10" "a\x05\x00", 4, out, sizeof(out))); // bad offset
+}
+
+void test_history_evicts_whole_blocks() {
+  static uint8_t arena[32 * 1024];
+  static LineHistory::Block index[64];
+  static LineHistory history;
+  TEST_ASSERT_TRUE(history.begin(arena, sizeof(arena), index, 64));
+
+  char line[64];
+  const uint32_t total = 20000;
+  for (uint32_t i = 0; i < total; i++) {
+    size_t n = snprintf(line, sizeof(line), "D (%u) app: loop %u state %u", i * 10, i, i % 5);
+    TEST_ASSERT_EQUAL(i, history.append(line, n, (int64_t)i * 1000, i & 1));
+  }
+  TEST_ASSERT_EQUAL(total, history.end());
+  TEST_ASSERT_GREATER_THAN(0, history.first());
+  TEST_ASSERT_GREATER_THAN(history.packedBytes(), history.rawBytes());
+
+  const char *text;
+  size_t len;
+  int64_t stamp;
+  uint8_t ch;
+  TEST_ASSERT_FALSE(history.get(history.first() - 1, &text, &len));
+  TEST_ASSERT_FALSE(history.get(history.end(), &text, &len));
+  for (uint32_t seq = history.first(); seq - history.first() < history.size(); seq += 7) {
+    TEST_ASSERT_TRUE(history.get(seq, &text, &len, &stamp, &ch));
+    size_t n = snprintf(line, sizeof(line), "D (%u) app: loop %u state %u", seq * 10, seq, seq % 5);
+    TEST_ASSERT_EQUAL(n, len);
+    TEST_ASSERT_EQUAL_MEMORY(line, text, n);
+    TEST_ASSERT_EQUAL((int64_t)seq * 1000, stamp);
+    TEST_ASSERT_EQUAL(seq & 1, ch);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_byte_ring_wraps_and_counts_drops);
+  RUN_TEST(test_broadcast_ring_overwrites_oldest);
+  RUN_TEST(test_ansi_sequence_split_across_chunks);
+  RUN_TEST(test_assembler_keeps_colours_as_markers);
+  RUN_TEST(test_assembler_rows_match_layout);
+  RUN_TEST(test_filter_include_exclude_highlight);
+  RUN_TEST(test_filter_matches_across_colours);
+  RUN_TEST(test_codec_round_trip);
+  RUN_TEST(test_history_evicts_whole_blocks);
+  return UNITY_END();
+}
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Turn a packed sd card log (/logNNNNN.lzb, SD_COMPRESS in src/sd_logger.h) back into text.
+
+usage: unpack_log.py log00000.lzb [more files] > log.txt
+
+A file is a sequence of frames: "LB", raw size and packed size (16 bit little endian) and the LZ4 block data,
+stored as is when both sizes are equal. Reading stops at the first damaged frame, like after a power loss.
+"""
+
+import struct
+import sys
+
+
+def unpack_block(src, raw):
+    out = bytearray()
+    i = 0
+    while i < len(src):
+        token = src[i]
+        i += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                b = src[i]
+                i += 1
+                lit += b
+                if b != 255:
+                    break
+        out += src[i:i + lit]
+        i += lit
+        if i >= len(src):
+            break
+        offset = src[i] | (src[i + 1] << 8)
+        i += 2
+        m = (token & 15) + 4
+        if token & 15 == 15:
+            while True:
+                b = src[i]
+                i += 1
+                m += b
+                if b != 255:
+                    break
+        for _ in range(m):  # matches may overlap what they produce
+            out.append(out[-offset])
+    if len(out) != raw:
+        raise ValueError("raw size mismatch")
+    return bytes(out)
+
+
+def unpack_file(path, out):
+    with open(path, "rb") as f:
+        data = f.read()
+    pos = 0
+    while pos + 6 <= len(data):
+        magic, raw, packed = struct.unpack_from("<2sHH", data, pos)
+        body = data[pos + 6:pos + 6 + packed]
+        if magic != b"LB" or len(body) != packed:
+            break
+        try:
+            out.write(body if packed == raw else unpack_block(body, raw))
+        except (IndexError, ValueError):
+            break
+        pos += 6 + packed
+    if pos != len(data):
+        sys.stderr.write("%s: stopped at offset %d of %d\n" % (path, pos, len(data)))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    for name in sys.argv[1:]:
+        unpack_file(name, sys.stdout.buffer)